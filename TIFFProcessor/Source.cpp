@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "TiffProvider.h"
+#include "TiffBatch.h"
 
 using namespace std;
 
@@ -30,9 +31,9 @@ void main(int argc, char *argv[])
 
 		printf("Usage: TIFFProcessor <action key> <input file> <output file>\n");
 		printf("<action key> Description:\n\n");
-		printf("-merge\t\tMerge two input files to create an output file.\n");
-		printf("\t\t\t	Usage: TIFFProcessor -merge input1.tiff input2.tif\n");
-		printf("\t\t\t	Contents of the second input file will be appended to the first input file.\n\n");
+		printf("-merge\t\tMerge two or more input files to create an output file.\n");
+		printf("\t\t\t	Usage: TIFFProcessor -merge input1.tiff input2.tif [input3.tif ...]\n");
+		printf("\t\t\t	Contents of the other input files will be appended to the first input file, in the given order.\n\n");
 
 		printf("<action key>: -rblank\t\tRemove all the blank pages from the input file\n");
 		printf("\t\t\t	Usage: TIFFProcessor -rblank input.tif output.tif\n");
@@ -55,6 +56,15 @@ void main(int argc, char *argv[])
 		printf("\t\t\t	Usage: TIFFProcessor -fileinfo input.tif output.tif\n");
 		printf("\t\t\t\tOutput file is optional. If output file is given, fileinfo will be written to the output file.\n\n");
 
+		printf("<action key>: -benchmark\tDecodes all the pages per scanline and per strip and displays the timings.\n");
+		printf("\t\t\t	Usage: TIFFProcessor -benchmark input.tif\n\n");
+
+		printf("<action key>: -batch\t\tRuns the operations of a manifest file on a pool of threads and reports the results.\n");
+		printf("\t\t\t	Usage: TIFFProcessor -batch manifest.txt report.txt\n");
+		printf("\t\t\t	One operation per line: <action key> <input file> [output file], lines starting with # are skipped.\n");
+		printf("\t\t\t	A * or ? in the input file name runs the operation on all the matching files, the output is then a directory.\n");
+		printf("\t\t\t	Report file is optional. The report is always displayed.\n\n");
+
 		printf("<action key>: -tiffparams\tDisplay the values of the TIFF params from the Settings.txt.\n");
 		printf("\t\t\t\tIf Settings.txt doesnt exisit or a specific TIFF param is not set in the settings.txt file, the default values are displayed.\n\n");
 
@@ -98,7 +108,29 @@ void ProcessCommands(std::vector<std::string>& vargs)
 			cout << "---------------" << endl;
 			cout << "TIFF files path set to : " << tiffParams._strFilesPath << endl;
 			cout << "TIFF files compression set to : " << tiffParams._strCompressType << endl;
-			cout << "TIFF binary files threshold set to : " << tiffParams._iThreshold << endl << endl;
+			cout << "TIFF binary files threshold set to : " << tiffParams._iThreshold << endl;
+			cout << "TIFF raw copy of unchanged pages set to : " << tiffParams._bRawCopy << endl;
+			cout << "TIFF page removal mode set to : " << tiffParams._strRemoveMode << endl;
+			cout << "TIFF merge mode set to : " << tiffParams._strMergeMode << endl;
+			cout << "BigTIFF output set to : " << tiffParams._strBigTIFF << endl;
+			cout << "TIFF output layout set to : " << tiffParams._strLayout << endl;
+			cout << "TIFF strip size set to : " << tiffParams._iStripSize << endl;
+			cout << "TIFF rows per strip set to : " << tiffParams._iRowsPerStrip << endl;
+			cout << "TIFF tile size set to : " << tiffParams._iTileWidth << "x" << tiffParams._iTileLength << endl;
+			cout << "TIFF blank page tolerance set to : " << tiffParams._iBlankTolerance << endl;
+			cout << "TIFF blank page max ink(%) set to : " << tiffParams._dBlankMaxInk << endl;
+			cout << "TIFF blank page margin(%) set to : " << tiffParams._iBlankMargin << endl;
+			cout << "TIFF blank page size prefilter set to : " << tiffParams._strBlankPrefilter << endl;
+			cout << "TIFF JPEG DCT analysis set to : " << tiffParams._bDctAnalysis << endl;
+			cout << "TIFF JPEG gray transcoding set to : " << tiffParams._bGrayTranscode << endl;
+			cout << "TIFF keep alpha on gray pages set to : " << tiffParams._bKeepAlpha << endl;
+			cout << "TIFF binarization set to : " << tiffParams._strBinarize << endl;
+			cout << "TIFF binarization window set to : " << tiffParams._iBinarizeWindow << endl;
+			cout << "TIFF sauvola k set to : " << tiffParams._dSauvolaK << endl;
+			cout << "TIFF bradley percent set to : " << tiffParams._iBradleyPercent << endl;
+			cout << "TIFF worker threads set to : " << tiffParams._iThreads << endl;
+			cout << "TIFF pipeline depth set to : " << tiffParams._iPipelineDepth << endl;
+			cout << "TIFF batch split pages set to : " << tiffParams._iBatchSplitPages << endl << endl;
 		}
 		return;
 	}
@@ -124,7 +156,11 @@ void ProcessCommands(std::vector<std::string>& vargs)
 			cout << "Insufficient argumnets passed." << endl;
 			return;
 		}
-		bRes = tifProvider.MergeFiles(infile, outfile);
+		std::vector<std::string> vInfiles;
+		for (std::size_t i = 1; i < vargs.size(); i++)
+			vInfiles.emplace_back(tiffParams._strFilesPath + vargs[i]);
+
+		bRes = tifProvider.MergeFiles(infile, vInfiles);
 	}
 	else if (commandName.find("-rpageno=", 0) != std::string::npos)
 	{
@@ -152,13 +188,52 @@ void ProcessCommands(std::vector<std::string>& vargs)
 		if(outfile.empty())
 			cout << strfileinfo << endl;
 	}
+	else if (commandName == "-benchmark")
+	{
+		std::string strReport = "";
+		bRes = tifProvider.Benchmark(infile, strReport);
+		cout << strReport << endl;
+	}
+	else if (commandName == "-batch")
+	{
+		CTiffBatch batch(tiffParams);
+		std::string strReport = "";
+
+		bRes = batch.ReadManifest(infile) && batch.Run(strReport, outfile);
+		cout << strReport << endl;
+
+		(bRes == true) ? cout << "Operation sucessful!!" << endl : cout << batch.GetErrorMsg().c_str() << endl;
+		return;
+	}
 	else if (commandName == "-tiffparams")
 	{
 		cout << "TIFF Parameters" << endl;
 		cout << "---------------" << endl;
 		cout << "TIFF files path set to : " << tiffParams._strFilesPath << endl;
 		cout << "TIFF files compression set to : " << tiffParams._strCompressType << endl;
-		cout << "TIFF binary files threshold set to : " << tiffParams._iThreshold << endl << endl;
+		cout << "TIFF binary files threshold set to : " << tiffParams._iThreshold << endl;
+		cout << "TIFF raw copy of unchanged pages set to : " << tiffParams._bRawCopy << endl;
+		cout << "TIFF page removal mode set to : " << tiffParams._strRemoveMode << endl;
+		cout << "TIFF merge mode set to : " << tiffParams._strMergeMode << endl;
+		cout << "BigTIFF output set to : " << tiffParams._strBigTIFF << endl;
+		cout << "TIFF output layout set to : " << tiffParams._strLayout << endl;
+		cout << "TIFF strip size set to : " << tiffParams._iStripSize << endl;
+		cout << "TIFF rows per strip set to : " << tiffParams._iRowsPerStrip << endl;
+		cout << "TIFF tile size set to : " << tiffParams._iTileWidth << "x" << tiffParams._iTileLength << endl;
+		cout << "TIFF blank page tolerance set to : " << tiffParams._iBlankTolerance << endl;
+		cout << "TIFF blank page max ink(%) set to : " << tiffParams._dBlankMaxInk << endl;
+		cout << "TIFF blank page margin(%) set to : " << tiffParams._iBlankMargin << endl;
+		cout << "TIFF blank page size prefilter set to : " << tiffParams._strBlankPrefilter << endl;
+		cout << "TIFF JPEG DCT analysis set to : " << tiffParams._bDctAnalysis << endl;
+		cout << "TIFF JPEG gray transcoding set to : " << tiffParams._bGrayTranscode << endl;
+		cout << "TIFF keep alpha on gray pages set to : " << tiffParams._bKeepAlpha << endl;
+		cout << "TIFF binarization set to : " << tiffParams._strBinarize << endl;
+		cout << "TIFF binarization window set to : " << tiffParams._iBinarizeWindow << endl;
+		cout << "TIFF sauvola k set to : " << tiffParams._dSauvolaK << endl;
+		cout << "TIFF bradley percent set to : " << tiffParams._iBradleyPercent << endl;
+		cout << "TIFF worker threads set to : " << tiffParams._iThreads << endl;
+		cout << "TIFF pipeline depth set to : " << tiffParams._iPipelineDepth << endl;
+		cout << "TIFF batch split pages set to : " << tiffParams._iBatchSplitPages << endl << endl;
 	}
 	else
 	{
@@ -209,6 +284,98 @@ bool GetTIFFParams(TIFFParams* params)
 			{
 				params->_iThreshold = std::stoi(vParams[1]);
 			}
+			if (vParams[0] == "rawcopy")
+			{
+				params->_bRawCopy = (std::stoi(vParams[1]) != 0);
+			}
+			if (vParams[0] == "removemode")
+			{
+				params->_strRemoveMode = vParams[1];
+			}
+			if (vParams[0] == "mergemode")
+			{
+				params->_strMergeMode = vParams[1];
+			}
+			if (vParams[0] == "bigtiff")
+			{
+				params->_strBigTIFF = vParams[1];
+			}
+			if (vParams[0] == "layout")
+			{
+				params->_strLayout = vParams[1];
+			}
+			if (vParams[0] == "stripsize")
+			{
+				params->_iStripSize = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "rowsperstrip")
+			{
+				params->_iRowsPerStrip = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "tilewidth")
+			{
+				params->_iTileWidth = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "tilelength")
+			{
+				params->_iTileLength = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "blanktolerance")
+			{
+				params->_iBlankTolerance = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "blankmaxink")
+			{
+				params->_dBlankMaxInk = std::stod(vParams[1]);
+			}
+			if (vParams[0] == "blankmargin")
+			{
+				params->_iBlankMargin = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "blankprefilter")
+			{
+				params->_strBlankPrefilter = vParams[1];
+			}
+			if (vParams[0] == "dctanalysis")
+			{
+				params->_bDctAnalysis = (std::stoi(vParams[1]) != 0);
+			}
+			if (vParams[0] == "graytranscode")
+			{
+				params->_bGrayTranscode = (std::stoi(vParams[1]) != 0);
+			}
+			if (vParams[0] == "keepalpha")
+			{
+				params->_bKeepAlpha = (std::stoi(vParams[1]) != 0);
+			}
+			if (vParams[0] == "binarize")
+			{
+				params->_strBinarize = vParams[1];
+			}
+			if (vParams[0] == "binarizewindow")
+			{
+				params->_iBinarizeWindow = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "sauvolak")
+			{
+				params->_dSauvolaK = std::stod(vParams[1]);
+			}
+			if (vParams[0] == "bradleypercent")
+			{
+				params->_iBradleyPercent = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "threads")
+			{
+				params->_iThreads = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "pipelinedepth")
+			{
+				params->_iPipelineDepth = std::stoi(vParams[1]);
+			}
+			if (vParams[0] == "batchsplitpages")
+			{
+				params->_iBatchSplitPages = std::stoi(vParams[1]);
+			}
 		}
 	}
 	fclose(fp);
@@ -0,0 +1,636 @@
+#include "TiffBatch.h"
+#include <numeric>
+
+//wildcard match of a file name, * is any run of characters and ? one character.
+//windows file names are not case sensitive
+static bool MatchName(const std::string& strPattern, const std::string& strName)
+{
+	size_t p = 0, n = 0, iStar = std::string::npos, iMatch = 0;
+
+	while (n < strName.size())
+	{
+		if ((p < strPattern.size()) && ((strPattern[p] == '?') || (tolower((unsigned char)strPattern[p]) == tolower((unsigned char)strName[n]))))
+		{
+			p++;
+			n++;
+		}
+		else if ((p < strPattern.size()) && (strPattern[p] == '*'))
+		{
+			iStar = p++;
+			iMatch = n;
+		}
+		else if (iStar != std::string::npos)
+		{
+			//let the last * take one more character
+			p = iStar + 1;
+			n = ++iMatch;
+		}
+		else
+			return false;
+	}
+
+	while ((p < strPattern.size()) && (strPattern[p] == '*'))
+		p++;
+
+	return p == strPattern.size();
+}
+
+//page numbers of -rpageno=p1,p2,p3
+static std::vector<std::string> SplitPages(const std::string& strPages)
+{
+	std::vector<std::string> vPages;
+	size_t iStart = 0, iFound = 0;
+
+	do
+	{
+		iFound = strPages.find(',', iStart);
+		vPages.push_back(strPages.substr(iStart, iFound - iStart));
+		iStart = iFound + 1;
+	} while (iFound != std::string::npos);
+
+	return vPages;
+}
+
+//size of a file in bytes, false if it cant be opened
+static bool GetFileSize(const std::string& strFile, uint64_t& iSize)
+{
+	FILE* fp = nullptr;
+	fopen_s(&fp, strFile.c_str(), "rb");
+	if (fp == nullptr)
+		return false;
+
+	int64_t iEnd = (_fseeki64(fp, 0, SEEK_END) == 0) ? _ftelli64(fp) : -1;
+	fclose(fp);
+
+	if (iEnd < 0)
+		return false;
+
+	iSize = (uint64_t)iEnd;
+	return true;
+}
+
+//position after the directory part of a path, 0 if there is none
+static size_t GetNamePos(const std::string& strPath)
+{
+	size_t iPos = strPath.find_last_of("\\/:");
+	return (iPos == std::string::npos) ? 0 : iPos + 1;
+}
+
+//the path of a file as a key for comparing, windows paths are not case sensitive and take both separators
+static std::string GetPathKey(const std::string& strPath)
+{
+	std::string strKey = strPath;
+	for (char& ch : strKey)
+		ch = (ch == '/') ? '\\' : (char)tolower((unsigned char)ch);
+
+	return strKey;
+}
+
+static std::string FormatSeconds(double dSeconds)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.2f", dSeconds);
+	return buffer;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CTiffBatch::CTiffBatch(TIFFParams& Params) : m_Params(Params), m_iSplitFiles(0), m_iPageTasks(0)
+{
+}
+
+std::string CTiffBatch::GetErrorMsg()
+{
+	return m_strErrorMsg;
+}
+
+std::vector<std::string> CTiffBatch::SplitLine(const std::string& strLine)
+{
+	//arguments are separated by blanks, names with blanks are put in double quotes
+	std::vector<std::string> vArgs;
+	std::string strArg = "";
+	bool bQuoted = false, bArg = false;
+
+	for (char ch : strLine)
+	{
+		if (ch == '"')
+		{
+			bQuoted = !bQuoted;
+			bArg = true;
+		}
+		else if (!bQuoted && ((ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n')))
+		{
+			if (bArg)
+				vArgs.push_back(strArg);
+
+			strArg.clear();
+			bArg = false;
+		}
+		else
+		{
+			strArg += ch;
+			bArg = true;
+		}
+	}
+
+	if (bArg)
+		vArgs.push_back(strArg);
+
+	return vArgs;
+}
+
+bool CTiffBatch::ExpandPattern(const std::string& strPattern, std::vector<std::string>& vFiles)
+{
+	//the names are matched here, FindFirstFile would also match the short 8.3 names of the files
+	size_t iNamePos = GetNamePos(strPattern);
+	std::string strDir = strPattern.substr(0, iNamePos);
+	std::string strName = strPattern.substr(iNamePos);
+	std::vector<std::string> vMatches;
+
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = FindFirstFileA((strDir + "*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		m_strErrorMsg = "Error reading directory: " + (strDir.empty() ? std::string(".") : strDir);
+		return false;
+	}
+
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && MatchName(strName, findData.cFileName))
+			vMatches.push_back(strDir + findData.cFileName);
+	} while (FindNextFileA(hFind, &findData));
+
+	FindClose(hFind);
+
+	//the files are taken in name order, -merge appends them in that order
+	std::sort(vMatches.begin(), vMatches.end());
+	vFiles.insert(vFiles.end(), vMatches.begin(), vMatches.end());
+	return true;
+}
+
+bool CTiffBatch::AddItem(uint32_t iLine, std::vector<std::string>& vArgs)
+{
+	std::string strCommand = vArgs[0];
+	std::string strLine = "Line " + std::to_string(iLine) + ": ";
+	bool bPageNumbers = (strCommand.find("-rpageno=") == 0);
+
+	if (!bPageNumbers && (strCommand != "-merge") && (strCommand != "-rblank") && (strCommand != "-togray") &&
+		(strCommand != "-tobinary") && (strCommand != "-fileinfo"))
+	{
+		m_strErrorMsg = strLine + "Invalid command key " + strCommand + "!!";
+		return false;
+	}
+
+	if ((vArgs.size() < 2) || ((strCommand == "-merge") && (vArgs.size() < 3)))
+	{
+		m_strErrorMsg = strLine + "Insufficient argumnets passed.";
+		return false;
+	}
+
+	//the page numbers are checked here, a bad number would otherwise stop the whole batch on a worker thread
+	if (bPageNumbers)
+	{
+		for (auto& page : SplitPages(strCommand.substr(9)))
+		{
+			if (page.empty() || (page.size() > 5) || (page.find_first_not_of("0123456789") != std::string::npos) || (std::stoi(page) > UINT16_MAX))
+			{
+				m_strErrorMsg = strLine + "Invalid page number " + page + "!!";
+				return false;
+			}
+		}
+	}
+
+	BatchItem item;
+	item._iLine = iLine;
+	item._strCommand = strCommand;
+	item._iSize = 0;
+
+	std::vector<std::string> vInputs;
+	uint64_t iSize = 0;
+
+	//-merge is one operation on all of its files, the target comes first and the other names may be patterns
+	if (strCommand == "-merge")
+	{
+		item._vFiles.push_back(m_Params._strFilesPath + vArgs[1]);
+		for (size_t i = 2; i < vArgs.size(); i++)
+		{
+			std::string strFile = m_Params._strFilesPath + vArgs[i];
+			if (strFile.find_first_of("*?") == std::string::npos)
+				item._vFiles.push_back(strFile);
+			else if (!ExpandPattern(strFile, item._vFiles))
+				return false;
+		}
+
+		//a file that cant be read counts as empty, the merge reports it
+		for (auto& strFile : item._vFiles)
+		{
+			if (GetFileSize(strFile, iSize))
+				item._iSize += iSize;
+		}
+
+		m_vItems.push_back(item);
+		return true;
+	}
+
+	std::string strInput = m_Params._strFilesPath + vArgs[1];
+	std::string strOutput = (vArgs.size() > 2) ? m_Params._strFilesPath + vArgs[2] : "";
+
+	bool bPattern = (strInput.find_first_of("*?") != std::string::npos);
+	if (!bPattern)
+		vInputs.push_back(strInput);
+	else if (!ExpandPattern(strInput, vInputs))
+		return false;
+
+	//with a pattern every file gets its own item, the output is the directory of the results
+	for (auto& strFile : vInputs)
+	{
+		item._vFiles.assign(1, strFile);
+		item._strOutput = strOutput;
+		if (!strOutput.empty() && bPattern)
+		{
+			bool bSeparator = (GetNamePos(strOutput) == strOutput.size());
+			item._strOutput = strOutput + (bSeparator ? "" : "\\") + strFile.substr(GetNamePos(strFile));
+		}
+
+		item._iSize = GetFileSize(strFile, iSize) ? iSize : 0;
+
+		m_vItems.push_back(item);
+	}
+
+	return true;
+}
+
+bool CTiffBatch::ReadManifest(const std::string& strManifest)
+{
+	char filedata[4096];
+	uint32_t iLine = 0;
+	bool bRes = true;
+	FILE* fp = nullptr;
+
+	m_strManifest = strManifest;
+	m_vItems.clear();
+
+	fopen_s(&fp, strManifest.c_str(), "r");
+	if (fp == nullptr)
+	{
+		m_strErrorMsg = "Error opening manifest: " + strManifest;
+		return false;
+	}
+
+	while (fgets(filedata, sizeof(filedata), fp) != nullptr)
+	{
+		iLine++;
+
+		//empty lines and comments(#) are skipped
+		std::vector<std::string> vArgs = SplitLine(filedata);
+		if (vArgs.empty() || (vArgs[0][0] == '#'))
+			continue;
+
+		if (!AddItem(iLine, vArgs))
+		{
+			bRes = false;
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	if (bRes && m_vItems.empty())
+	{
+		m_strErrorMsg = "No operations found in manifest: " + strManifest;
+		bRes = false;
+	}
+
+	return bRes;
+}
+
+uint16_t CTiffBatch::GetPageCount(const std::string& strFile)
+{
+	TIFF* pFile = TIFFOpen(strFile.c_str(), "r");
+	if (!pFile)
+		return 0;
+
+	uint16_t iPageCount = TIFFNumberOfDirectories(pFile);
+	TIFFClose(pFile);
+
+	return iPageCount;
+}
+
+bool CTiffBatch::RunItem(const BatchItem& item, std::string& strError)
+{
+	//the pool runs a file per thread, so the provider works with one thread
+	TIFFParams params = m_Params;
+	params._iThreads = 1;
+
+	CTiffProvider provider(params);
+	std::string infile = item._vFiles[0];
+	bool bRes = false;
+
+	if (item._strCommand == "-merge")
+	{
+		std::vector<std::string> vInfiles(item._vFiles.begin() + 1, item._vFiles.end());
+		bRes = provider.MergeFiles(infile, vInfiles);
+	}
+	else if (item._strCommand.find("-rpageno=") == 0)
+	{
+		std::set<uint16_t> vPagenumbers;
+		for (auto& page : SplitPages(item._strCommand.substr(9)))
+			vPagenumbers.emplace((uint16_t)std::stoi(page));
+
+		bRes = provider.RemovePageByNumber(infile, vPagenumbers, item._strOutput);
+	}
+	else if (item._strCommand == "-rblank")
+		bRes = provider.RemoveBlankPages(infile, item._strOutput);
+	else if (item._strCommand == "-togray")
+		bRes = provider.ConvertPageTo(infile, CTiffProvider::m_eConvertCode::TOGRAY, item._strOutput);
+	else if (item._strCommand == "-tobinary")
+		bRes = provider.ConvertPageTo(infile, CTiffProvider::m_eConvertCode::TOBINARY, item._strOutput);
+	else if (item._strCommand == "-fileinfo")
+	{
+		std::string strfileinfo = "";
+		bRes = provider.GetFileInfo(infile, strfileinfo, item._strOutput);
+	}
+
+	if (!bRes)
+	{
+		strError = provider.GetErrorMsg();
+		if (strError.empty())
+			strError = "Operation failed!!";
+	}
+
+	return bRes;
+}
+
+void CTiffBatch::RunFileTask(CTiffTaskPool& pool, size_t iItem)
+{
+	const BatchItem& item = m_vItems[iItem];
+	BatchResult& result = m_vResults[iItem];
+	auto start = std::chrono::steady_clock::now();
+
+	//conversions of files with many pages are split into tasks of a few pages, idle threads steal them.
+	//each task converts its pages into a part file, the last one to finish appends the parts to the first
+	bool bConvert = (item._strCommand == "-togray") || (item._strCommand == "-tobinary");
+	uint32_t iSplitPages = m_Params._iBatchSplitPages;
+	uint16_t iPageCount = (bConvert && (iSplitPages > 0)) ? GetPageCount(item._vFiles[0]) : 0;
+
+	if (iPageCount > iSplitPages)
+	{
+		uint32_t iParts = (iPageCount + iSplitPages - 1) / iSplitPages;
+		std::string strTarget = item._strOutput.empty() ? item._vFiles[0] : item._strOutput;
+		std::shared_ptr<SplitState> pState = std::make_shared<SplitState>();
+
+		pState->_iLeft = iParts;
+		pState->_start = start;
+		for (uint32_t i = 0; i < iParts; i++)
+			pState->_vParts.push_back(strTarget + ".part" + std::to_string(i) + ".tmp");
+
+		result._iPageTasks = iParts;
+		m_iSplitFiles++;
+		m_iPageTasks += iParts;
+
+		for (uint32_t i = 0; i < iParts; i++)
+		{
+			uint16_t iFirstPage = (uint16_t)(i * iSplitPages + 1);
+			uint16_t iLastPage = (uint16_t)std::min((uint32_t)iPageCount, (i + 1) * iSplitPages);
+			pool.Submit([this, &pool, iItem, pState, i, iFirstPage, iLastPage, iPageCount]() { RunPageTask(pool, iItem, pState, i, iFirstPage, iLastPage, iPageCount); });
+		}
+
+		return;
+	}
+
+	std::string strError = "";
+	result._bDone = RunItem(item, strError);
+	result._strError = strError;
+	result._dSeconds = SecondsSince(start);
+
+	StartNext(pool, iItem);
+}
+
+void CTiffBatch::RunPageTask(CTiffTaskPool& pool, size_t iItem, std::shared_ptr<SplitState> pState, uint32_t iPart, uint16_t iFirstPage, uint16_t iLastPage, uint16_t iPageCount)
+{
+	const BatchItem& item = m_vItems[iItem];
+	SplitState& state = *pState;
+
+	TIFFParams params = m_Params;
+	params._iThreads = 1;
+
+	//the pages of the task are copied raw into the part file, which is then converted in place
+	CTiffProvider provider(params);
+	std::string infile = item._vFiles[0];
+	std::string partfile = state._vParts[iPart];
+	std::set<uint16_t> vPagenumbers;
+
+	for (uint32_t pno = 1; pno <= iPageCount; pno++)
+	{
+		if ((pno < iFirstPage) || (pno > iLastPage))
+			vPagenumbers.emplace((uint16_t)pno);
+	}
+
+	CTiffProvider::m_eConvertCode ccode = (item._strCommand == "-togray") ? CTiffProvider::m_eConvertCode::TOGRAY : CTiffProvider::m_eConvertCode::TOBINARY;
+	bool bRes = provider.RemovePageByNumber(infile, vPagenumbers, partfile) && provider.ConvertPageTo(partfile, ccode);
+
+	if (!bRes)
+	{
+		std::lock_guard<std::mutex> lock(state._mutex);
+		if (state._strError.empty())
+			state._strError = "Pages " + std::to_string(iFirstPage) + "-" + std::to_string(iLastPage) + ": " + provider.GetErrorMsg();
+	}
+
+	if (--state._iLeft == 0)
+		JoinParts(pool, iItem, state);
+}
+
+void CTiffBatch::JoinParts(CTiffTaskPool& pool, size_t iItem, SplitState& state)
+{
+	const BatchItem& item = m_vItems[iItem];
+	BatchResult& result = m_vResults[iItem];
+	std::string strTarget = item._strOutput.empty() ? item._vFiles[0] : item._strOutput;
+	std::string strError = "";
+	{
+		std::lock_guard<std::mutex> lock(state._mutex);
+		strError = state._strError;
+	}
+
+	//the parts are appended to the first one without decoding them, it then takes the place of the target
+	if (strError.empty())
+	{
+		TIFFParams params = m_Params;
+		params._iThreads = 1;
+		params._strMergeMode = "append";
+
+		CTiffProvider provider(params);
+		std::vector<std::string> vInfiles(state._vParts.begin() + 1, state._vParts.end());
+		if (!provider.MergeFiles(state._vParts[0], vInfiles))
+			strError = "Error joining the page tasks: " + provider.GetErrorMsg();
+	}
+
+	for (size_t i = 1; i < state._vParts.size(); i++)
+		std::remove(state._vParts[i].c_str());
+
+	if (strError.empty())
+	{
+		std::remove(strTarget.c_str());
+		if (std::rename(state._vParts[0].c_str(), strTarget.c_str()) != 0)
+			strError = "Error creating output file: " + strTarget;
+	}
+
+	if (!strError.empty())
+		std::remove(state._vParts[0].c_str());
+
+	result._bDone = strError.empty();
+	result._strError = strError;
+	result._dSeconds = SecondsSince(state._start);
+
+	StartNext(pool, iItem);
+}
+
+void CTiffBatch::StartNext(CTiffTaskPool& pool, size_t iItem)
+{
+	//the next operation on the same files waits until this one is done, failed or not
+	size_t iNext = m_vNext[iItem];
+	if (iNext != SIZE_MAX)
+		pool.Submit([this, &pool, iNext]() { RunFileTask(pool, iNext); });
+}
+
+std::vector<size_t> CTiffBatch::ChainItems(std::vector<uint64_t>& vChainSizes)
+{
+	//items that share a file, directly or through other items, are put in one chain in manifest order.
+	//returns the first item of every chain, vChainSizes gets the bytes of all the items of each chain
+	std::vector<size_t> vGroups(m_vItems.size());
+	std::map<std::string, size_t> mapFiles;
+	std::iota(vGroups.begin(), vGroups.end(), 0);
+
+	auto fnGroup = [&](size_t iItem)
+	{
+		while (vGroups[iItem] != iItem)
+			iItem = vGroups[iItem] = vGroups[vGroups[iItem]];
+		return iItem;
+	};
+
+	for (size_t i = 0; i < m_vItems.size(); i++)
+	{
+		std::vector<std::string> vFiles = m_vItems[i]._vFiles;
+		if (!m_vItems[i]._strOutput.empty())
+			vFiles.push_back(m_vItems[i]._strOutput);
+
+		for (auto& strFile : vFiles)
+		{
+			auto result = mapFiles.emplace(GetPathKey(strFile), i);
+			if (!result.second)
+			{
+				//the group of the earlier item keeps the lower number
+				size_t a = fnGroup(result.first->second), b = fnGroup(i);
+				vGroups[std::max(a, b)] = std::min(a, b);
+			}
+		}
+	}
+
+	std::vector<size_t> vFirst, vLast(m_vItems.size(), SIZE_MAX);
+	m_vNext.assign(m_vItems.size(), SIZE_MAX);
+	vChainSizes.assign(m_vItems.size(), 0);
+
+	for (size_t i = 0; i < m_vItems.size(); i++)
+	{
+		size_t iGroup = fnGroup(i);
+		if (vLast[iGroup] == SIZE_MAX)
+			vFirst.push_back(i);
+		else
+			m_vNext[vLast[iGroup]] = i;
+
+		//the first item of a chain is the number of its group
+		vLast[iGroup] = i;
+		vChainSizes[iGroup] += m_vItems[i]._iSize;
+	}
+
+	return vFirst;
+}
+
+std::string CTiffBatch::GetReport(unsigned iThreads, uint64_t iStolen, double dSeconds)
+{
+	uint32_t iDone = 0;
+	size_t iSlowest = 0;
+	std::string strFailed = "";
+
+	for (size_t i = 0; i < m_vResults.size(); i++)
+	{
+		const BatchItem& item = m_vItems[i];
+		const BatchResult& result = m_vResults[i];
+
+		if (result._bDone)
+			iDone++;
+		else
+			strFailed.append("Line " + std::to_string(item._iLine) + ": " + item._strCommand + " " + item._vFiles[0] + ": " + result._strError + "\n");
+
+		if (result._dSeconds > m_vResults[iSlowest]._dSeconds)
+			iSlowest = i;
+	}
+
+	std::string strReport = "Batch report: " + m_strManifest + "\n";
+	strReport.append("---------------\n");
+	strReport.append("Operations: " + std::to_string(m_vResults.size()) + ", done: " + std::to_string(iDone) + ", failed: " + std::to_string(m_vResults.size() - iDone) + "\n");
+	strReport.append("Threads: " + std::to_string(iThreads) + ", tasks stolen: " + std::to_string(iStolen) + "\n");
+	strReport.append("Files split into page tasks: " + std::to_string(m_iSplitFiles) + " (" + std::to_string(m_iPageTasks) + " page tasks)\n");
+	strReport.append("Time: " + FormatSeconds(dSeconds) + " s\n");
+
+	if (!m_vResults.empty())
+		strReport.append("Slowest: line " + std::to_string(m_vItems[iSlowest]._iLine) + " " + m_vItems[iSlowest]._vFiles[0] + " (" + FormatSeconds(m_vResults[iSlowest]._dSeconds) + " s)\n");
+
+	if (!strFailed.empty())
+	{
+		strReport.append("\nFailed operations:\n");
+		strReport.append(strFailed);
+	}
+
+	return strReport;
+}
+
+bool CTiffBatch::Run(std::string& report, std::string reportfile)
+{
+	unsigned iThreads = m_Params._iThreads ? m_Params._iThreads : std::max(1u, std::thread::hardware_concurrency());
+
+	m_vResults.assign(m_vItems.size(), BatchResult());
+	m_iSplitFiles = 0;
+	m_iPageTasks = 0;
+
+	//the largest chains of files are started first, the small ones fill the gaps at the end.
+	//the other items of a chain are started by the item before them
+	std::vector<uint64_t> vChainSizes;
+	std::vector<size_t> vOrder = ChainItems(vChainSizes);
+	std::stable_sort(vOrder.begin(), vOrder.end(), [&](size_t a, size_t b) { return vChainSizes[a] > vChainSizes[b]; });
+
+	CTiffTaskPool pool(iThreads);
+	for (size_t iItem : vOrder)
+		pool.Submit([this, &pool, iItem]() { RunFileTask(pool, iItem); });
+
+	auto start = std::chrono::steady_clock::now();
+	pool.Run();
+
+	report = GetReport(pool.GetThreads(), pool.GetStolenTasks(), SecondsSince(start));
+
+	if (!reportfile.empty())
+	{
+		FILE* pOutfile = nullptr;
+		fopen_s(&pOutfile, reportfile.c_str(), "w");
+		if (!pOutfile)
+		{
+			m_strErrorMsg = "Error opening outfile: " + reportfile;
+			return false;
+		}
+
+		fprintf(pOutfile, "%s", report.c_str());
+		fclose(pOutfile);
+	}
+
+	size_t iFailed = std::count_if(m_vResults.begin(), m_vResults.end(), [](const BatchResult& result) { return !result._bDone; });
+	if (iFailed > 0)
+	{
+		m_strErrorMsg = std::to_string(iFailed) + " of " + std::to_string(m_vResults.size()) + " operations failed!!";
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "TiffProvider.h"
+#include "TiffTaskPool.h"
+#include <atomic>
+#include <mutex>
+
+//an operation of the manifest on one file(or on the files of a -merge)
+typedef struct BatchItem
+{
+	uint32_t _iLine;						//line of the manifest, for the report
+	std::string _strCommand;				//action key as on the command line
+	std::vector<std::string> _vFiles;		//input file, -merge has the target first
+	std::string _strOutput;					//empty to write to the input file
+	uint64_t _iSize;						//bytes of the input files, large files are started first
+}BatchItem;
+
+//the outcome of an item, filled in by the task that finishes it
+typedef struct BatchResult
+{
+	bool _bDone = false;
+	std::string _strError = "";
+	double _dSeconds = 0;
+	uint32_t _iPageTasks = 0;				//tasks the pages of the file were split into, 0 if it was not split
+}BatchResult;
+
+//a file split into page tasks, shared by its tasks. the last task to finish joins the parts
+typedef struct SplitState
+{
+	std::vector<std::string> _vParts;		//part files, one per page task
+	std::atomic<uint32_t> _iLeft;
+	std::mutex _mutex;
+	std::string _strError = "";
+	std::chrono::steady_clock::time_point _start;
+}SplitState;
+
+//runs the operations of a manifest on a work-stealing task pool, one task per file.
+//files with many pages are split into page tasks, so a few large files dont keep the
+//other threads waiting at the end, and one report is made of all the results.
+//operations that share an input or output file are run one after the other in manifest order
+class CTiffBatch
+{
+private:
+	TIFFParams m_Params;
+	std::string m_strErrorMsg = "";
+	std::string m_strManifest = "";
+	std::vector<BatchItem> m_vItems;
+	std::vector<BatchResult> m_vResults;
+	std::vector<size_t> m_vNext;			//next operation on the same files, started when the item is done
+	std::atomic<uint32_t> m_iSplitFiles;
+	std::atomic<uint32_t> m_iPageTasks;
+
+	bool AddItem(uint32_t iLine, std::vector<std::string>& vArgs);
+	bool ExpandPattern(const std::string& strPattern, std::vector<std::string>& vFiles);
+	std::vector<std::string> SplitLine(const std::string& strLine);
+	uint16_t GetPageCount(const std::string& strFile);
+	std::vector<size_t> ChainItems(std::vector<uint64_t>& vChainSizes);
+
+	bool RunItem(const BatchItem& item, std::string& strError);
+	void RunFileTask(CTiffTaskPool& pool, size_t iItem);
+	void RunPageTask(CTiffTaskPool& pool, size_t iItem, std::shared_ptr<SplitState> pState, uint32_t iPart, uint16_t iFirstPage, uint16_t iLastPage, uint16_t iPageCount);
+	void JoinParts(CTiffTaskPool& pool, size_t iItem, SplitState& state);
+	void StartNext(CTiffTaskPool& pool, size_t iItem);
+	std::string GetReport(unsigned iThreads, uint64_t iStolen, double dSeconds);
+
+public:
+	CTiffBatch(TIFFParams& Params);
+	~CTiffBatch() = default;
+
+	//avoid copying of this objects
+	CTiffBatch(const CTiffBatch& second) = delete;
+
+	//reads the operations, one per line: <action key> <input file> [output file]. a * or ? in the name of
+	//the input file runs the operation on every file of the directory that matches, the output is then a directory
+	bool ReadManifest(const std::string& strManifest);
+
+	//runs all the operations, false if any of them failed. the report is also written to reportfile if given
+	bool Run(std::string& report, std::string reportfile = "");
+
+	std::string GetErrorMsg();
+};
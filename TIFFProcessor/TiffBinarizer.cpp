@@ -0,0 +1,349 @@
+#include "TiffBinarizer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+//rows binarized by a thread at a time, the halo adds a window of rows to every band
+static const uint32_t BAND_ROWS = 128;
+
+//dynamic range of the deviation in Sauvola's formula
+static const double SAUVOLA_R = 128.0;
+
+//error diffusion waits for the row above once per block of pixels, pages narrower than
+//a few blocks are diffused on one thread
+static const uint32_t DITHER_BLOCK = 64;
+static const uint32_t WAVEFRONT_MIN_WIDTH = 512;
+
+//Floyd-Steinberg: 7/16 of the error to the right, 3/16, 5/16 and 1/16 to the row below.
+//the error rows have 2 columns of padding at each side. gray + error below 128 is black(bit set)
+static void DiffuseFloydSteinberg(const unsigned char* pRow, unsigned char* pBitRow, int32_t** pError, uint32_t x0, uint32_t x1)
+{
+	int32_t* pCurrent = pError[0];
+	int32_t* pBelow = pError[1];
+	int32_t* pBelowLeft = pError[1] - 1;
+
+	for (uint32_t x = x0; x < x1; x += 8)
+	{
+		unsigned iByte = 0;
+		uint32_t iEnd = std::min(x1, x + 8);
+
+		for (uint32_t i = x; i < iEnd; i++)
+		{
+			int32_t v = pRow[i] + pCurrent[i];
+			int32_t e = v;
+
+			if (v < 128)
+				iByte |= 0x80 >> (i - x);
+			else
+				e = v - 255;
+
+			pCurrent[i + 1] += (e * 7) >> 4;
+			pBelowLeft[i] += (e * 3) >> 4;
+			pBelow[i] += (e * 5) >> 4;
+			pBelow[i + 1] += e >> 4;
+		}
+
+		pBitRow[x >> 3] = (unsigned char)iByte;
+	}
+}
+
+//Atkinson: 1/8 of the error to 2 pixels on the right, 3 below and 1 two rows below, the rest is dropped
+static void DiffuseAtkinson(const unsigned char* pRow, unsigned char* pBitRow, int32_t** pError, uint32_t x0, uint32_t x1)
+{
+	int32_t* pCurrent = pError[0];
+	int32_t* pBelow = pError[1];
+	int32_t* pBelowLeft = pError[1] - 1;
+	int32_t* pBelow2 = pError[2];
+
+	for (uint32_t x = x0; x < x1; x += 8)
+	{
+		unsigned iByte = 0;
+		uint32_t iEnd = std::min(x1, x + 8);
+
+		for (uint32_t i = x; i < iEnd; i++)
+		{
+			int32_t v = pRow[i] + pCurrent[i];
+			int32_t e = v;
+
+			if (v < 128)
+				iByte |= 0x80 >> (i - x);
+			else
+				e = v - 255;
+
+			e >>= 3;
+			pCurrent[i + 1] += e;
+			pCurrent[i + 2] += e;
+			pBelowLeft[i] += e;
+			pBelow[i] += e;
+			pBelow[i + 1] += e;
+			pBelow2[i] += e;
+		}
+
+		pBitRow[x >> 3] = (unsigned char)iByte;
+	}
+}
+
+CTiffBinarizer::CTiffBinarizer(m_eMethod eMethod, uint32_t iWindow, double dK, unsigned iThreads) : m_Method(eMethod), m_dK(dK), m_iThreads(iThreads)
+{
+	m_iRadius = std::max<uint32_t>(iWindow, 3) / 2;
+}
+
+unsigned CTiffBinarizer::GetThreads(uint32_t iUnits)
+{
+	unsigned iThreads = m_iThreads ? m_iThreads : std::max(1u, std::thread::hardware_concurrency());
+	return std::max(1u, std::min<unsigned>(iThreads, iUnits));
+}
+
+bool CTiffBinarizer::IsDither() const
+{
+	return (m_Method == FLOYD_STEINBERG) || (m_Method == ATKINSON);
+}
+
+const unsigned char* CTiffBinarizer::GetGrayRow(uint32_t y) const
+{
+	return m_vGray.data() + (size_t)(y - m_iGrayTop) * m_iWidth;
+}
+
+unsigned char* CTiffBinarizer::GetBitRow(uint32_t y)
+{
+	return m_vBits.data() + (size_t)(y - m_iDone) * m_iBitStride;
+}
+
+void CTiffBinarizer::Begin(uint32_t iWidth, uint32_t iHeight, const RowsFunction& fnRows)
+{
+	m_iWidth = iWidth;
+	m_iHeight = iHeight;
+	m_fnRows = fnRows;
+	m_iGrayTop = 0;
+	m_iGrayRows = 0;
+	m_iDone = 0;
+	m_iBitStride = ((size_t)iWidth + 7) / 8;
+
+	//a band for every thread plus the halo above and below them
+	uint32_t iBands = (iHeight + BAND_ROWS - 1) / BAND_ROWS;
+	m_iGrayCapacity = std::min(iHeight, GetThreads(iBands) * BAND_ROWS + (IsDither() ? 0 : 2 * m_iRadius));
+	m_vGray.resize((size_t)m_iGrayCapacity * iWidth);
+
+	if (IsDither())
+	{
+		//the error rows have 2 columns of padding at each side
+		m_iDitherThreads = (iWidth >= WAVEFRONT_MIN_WIDTH) ? GetThreads(iHeight) : 1;
+		m_iErrorRows = m_iDitherThreads + 2;
+		m_iErrorStride = (size_t)iWidth + 4;
+		m_vError.assign(m_iErrorRows * m_iErrorStride, 0);
+
+		m_pProgress.reset(new std::atomic<uint64_t>[m_iErrorRows]);
+		for (uint32_t i = 0; i < m_iErrorRows; i++)
+			m_pProgress[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+bool CTiffBinarizer::AddRows(const unsigned char* pGray, size_t iGrayStride, uint32_t iRows)
+{
+	for (uint32_t row = 0; row < iRows; row++)
+	{
+		if (m_iGrayTop + m_iGrayRows >= m_iHeight)
+			return false;
+
+		memcpy(m_vGray.data() + (size_t)m_iGrayRows * m_iWidth, pGray + row * iGrayStride, m_iWidth);
+		m_iGrayRows++;
+
+		if (((m_iGrayRows == m_iGrayCapacity) || (m_iGrayTop + m_iGrayRows == m_iHeight)) && !Process())
+			return false;
+	}
+
+	return true;
+}
+
+bool CTiffBinarizer::Process()
+{
+	//a row is final once the rows of its window below it are in
+	uint32_t iHalo = IsDither() ? 0 : m_iRadius;
+	uint32_t iLoaded = m_iGrayTop + m_iGrayRows;
+	uint32_t iEnd = (iLoaded == m_iHeight) ? m_iHeight : ((iLoaded > iHalo) ? iLoaded - iHalo : 0);
+
+	if (iEnd <= m_iDone)
+		return true;
+
+	m_vBits.assign((size_t)(iEnd - m_iDone) * m_iBitStride, 0);
+
+	if (IsDither())
+		Dither(iEnd);
+	else
+	{
+		uint32_t iBands = (iEnd - m_iDone + BAND_ROWS - 1) / BAND_ROWS;
+		unsigned iThreads = GetThreads(iBands);
+
+		if (m_vSums.size() < iThreads)
+			m_vSums.resize(iThreads);
+
+		//the bands are handed out in order, a thread takes the next one as it is done
+		std::atomic<uint32_t> iNextBand(0);
+		auto worker = [&](unsigned iThread)
+		{
+			for (uint32_t band = iNextBand++; band < iBands; band = iNextBand++)
+			{
+				uint32_t iTop = m_iDone + band * BAND_ROWS;
+				BinarizeBand(iTop, std::min(iEnd, iTop + BAND_ROWS), m_vSums[iThread]);
+			}
+		};
+
+		std::vector<std::thread> vThreads;
+		for (unsigned i = 1; i < iThreads; i++)
+			vThreads.emplace_back(worker, i);
+
+		worker(0);
+
+		for (std::thread& thread : vThreads)
+			thread.join();
+	}
+
+	if (!m_fnRows(m_iDone, iEnd - m_iDone, m_vBits.data(), m_iBitStride))
+		return false;
+
+	m_iDone = iEnd;
+
+	//the rows above the window of the next row are dropped
+	uint32_t iKeep = (m_iDone > iHalo) ? m_iDone - iHalo : 0;
+	if (iKeep > m_iGrayTop)
+	{
+		uint32_t iDropped = iKeep - m_iGrayTop;
+		memmove(m_vGray.data(), m_vGray.data() + (size_t)iDropped * m_iWidth, (size_t)(m_iGrayRows - iDropped) * m_iWidth);
+		m_iGrayTop = iKeep;
+		m_iGrayRows -= iDropped;
+	}
+
+	return true;
+}
+
+void CTiffBinarizer::Dither(uint32_t iEnd)
+{
+	//error diffusion is serial along a row, the rows run as a wavefront instead: a thread takes the next row and
+	//follows the row above 3 pixels behind it. by then the error of the row above is complete for these pixels and
+	//the row above writes no error they touch. the output is the one of a single thread
+	unsigned iThreads = std::min<unsigned>(m_iDitherThreads, iEnd - m_iDone);
+
+	//error rows of the rows in flight and of the 2 rows below them. the rows are done in order,
+	//so the row that used a buffer before is done when a row clears it for the row 2 below itself.
+	//the progress of a row is tagged with the row, so a row never takes the progress of the row that
+	//had the counter before for the one of the row above it
+	std::atomic<uint32_t> iNextRow(m_iDone);
+	auto worker = [&]()
+	{
+		for (uint32_t y = iNextRow++; y < iEnd; y = iNextRow++)
+		{
+			int32_t* pError[3];
+			for (uint32_t i = 0; i < 3; i++)
+				pError[i] = m_vError.data() + ((y + i) % m_iErrorRows) * m_iErrorStride + 2;
+
+			std::fill(pError[2] - 2, pError[2] - 2 + m_iErrorStride, 0);
+			std::atomic<uint64_t>& progress = m_pProgress[y % m_iErrorRows];
+			uint64_t iTag = (uint64_t)(y + 1) << 32;
+
+			const unsigned char* pRow = GetGrayRow(y);
+			unsigned char* pBitRow = GetBitRow(y);
+
+			for (uint32_t x0 = 0; x0 < m_iWidth; x0 += DITHER_BLOCK)
+			{
+				uint32_t x1 = std::min(m_iWidth, x0 + DITHER_BLOCK);
+
+				if (y > 0)
+				{
+					uint64_t iAhead = ((uint64_t)y << 32) | std::min(m_iWidth, x1 + 3);
+					while (m_pProgress[(y - 1) % m_iErrorRows].load(std::memory_order_acquire) < iAhead)
+						std::this_thread::yield();
+				}
+
+				if (m_Method == FLOYD_STEINBERG)
+					DiffuseFloydSteinberg(pRow, pBitRow, pError, x0, x1);
+				else
+					DiffuseAtkinson(pRow, pBitRow, pError, x0, x1);
+
+				progress.store(iTag | x1, std::memory_order_release);
+			}
+		}
+	};
+
+	std::vector<std::thread> vThreads;
+	for (unsigned i = 1; i < iThreads; i++)
+		vThreads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread& thread : vThreads)
+		thread.join();
+}
+
+void CTiffBinarizer::BinarizeBand(uint32_t iTop, uint32_t iBottom, BandSums& sums)
+{
+	//rows of the band and its halo
+	uint32_t iFirst = (iTop > m_iRadius) ? iTop - m_iRadius : 0;
+	uint32_t iLast = std::min(m_iHeight, iBottom + m_iRadius);
+	size_t iStride = (size_t)m_iWidth + 1;
+
+	sums._vSum.resize((size_t)(iLast - iFirst + 1) * iStride);
+	sums._vSquares.resize(sums._vSum.size());
+
+	uint64_t* pSum = sums._vSum.data();
+	uint64_t* pSquares = sums._vSquares.data();
+	std::fill(pSum, pSum + iStride, 0);
+	std::fill(pSquares, pSquares + iStride, 0);
+
+	for (uint32_t y = iFirst; y < iLast; y++)
+	{
+		const unsigned char* pRow = GetGrayRow(y);
+		uint64_t* pSumAbove = pSum + (size_t)(y - iFirst) * iStride;
+		uint64_t* pSquaresAbove = pSquares + (size_t)(y - iFirst) * iStride;
+		uint64_t iRowSum = 0, iRowSquares = 0;
+
+		pSumAbove[iStride] = 0;
+		pSquaresAbove[iStride] = 0;
+
+		for (uint32_t x = 0; x < m_iWidth; x++)
+		{
+			iRowSum += pRow[x];
+			iRowSquares += (uint32_t)pRow[x] * pRow[x];
+			pSumAbove[iStride + x + 1] = pSumAbove[x + 1] + iRowSum;
+			pSquaresAbove[iStride + x + 1] = pSquaresAbove[x + 1] + iRowSquares;
+		}
+	}
+
+	for (uint32_t y = iTop; y < iBottom; y++)
+	{
+		const unsigned char* pRow = GetGrayRow(y);
+		unsigned char* pBitRow = GetBitRow(y);
+
+		//window rows, clipped at the edges of the page
+		size_t iUpper = (size_t)((y > m_iRadius) ? y - m_iRadius : 0) - iFirst;
+		size_t iLower = (size_t)std::min(m_iHeight, y + m_iRadius + 1) - iFirst;
+		const uint64_t* pSumUpper = pSum + iUpper * iStride;
+		const uint64_t* pSumLower = pSum + iLower * iStride;
+		const uint64_t* pSquaresUpper = pSquares + iUpper * iStride;
+		const uint64_t* pSquaresLower = pSquares + iLower * iStride;
+
+		for (uint32_t x = 0; x < m_iWidth; x++)
+		{
+			uint32_t iLeft = (x > m_iRadius) ? x - m_iRadius : 0;
+			uint32_t iRight = std::min(m_iWidth, x + m_iRadius + 1);
+			double dCount = (double)((iLower - iUpper) * (iRight - iLeft));
+
+			double dMean = (double)(pSumLower[iRight] - pSumUpper[iRight] - pSumLower[iLeft] + pSumUpper[iLeft]) / dCount;
+			double dThreshold;
+
+			if (m_Method == SAUVOLA)
+			{
+				double dSquares = (double)(pSquaresLower[iRight] - pSquaresUpper[iRight] - pSquaresLower[iLeft] + pSquaresUpper[iLeft]) / dCount;
+				double dDeviation = std::sqrt(std::max(0.0, dSquares - dMean * dMean));
+				dThreshold = dMean * (1.0 + m_dK * (dDeviation / SAUVOLA_R - 1.0));
+			}
+			else
+				dThreshold = dMean * (1.0 - m_dK);
+
+			if (pRow[x] <= dThreshold)
+				pBitRow[x >> 3] |= (unsigned char)(0x80 >> (x & 7));
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+//local thresholds for pages with uneven lighting or shadows, every pixel is compared with the mean(Bradley) or
+//the mean and deviation(Sauvola) of the window around it. the sums over the windows come from integral images.
+//the gray rows of a page are streamed in from the top. once the rows below a band of rows are in, the band is binarized
+//on its own thread from the integral images of its rows plus half a window above and below(the halo) and handed on,
+//so only the bands in work and a window of rows are held whatever the height of the page.
+//error diffusion(Floyd-Steinberg, Atkinson) keeps photos and halftones as dot patterns instead of wiping them out
+class CTiffBinarizer
+{
+public:
+	typedef enum Method { SAUVOLA = 0, BRADLEY, FLOYD_STEINBERG, ATKINSON } m_eMethod;
+
+	//gets the final bit rows of the page in order, iRows rows from row y on
+	typedef std::function<bool(uint32_t y, uint32_t iRows, const unsigned char* pBits, size_t iBitStride)> RowsFunction;
+
+private:
+	m_eMethod m_Method = SAUVOLA;
+	uint32_t m_iRadius = 15;		//half of the window size
+	double m_dK = 0.2;				//Sauvola k, or the fraction below the mean for Bradley
+	unsigned m_iThreads = 0;
+
+	//the page in work
+	uint32_t m_iWidth = 0;
+	uint32_t m_iHeight = 0;
+	RowsFunction m_fnRows;
+	std::vector<unsigned char> m_vGray;	//m_iGrayRows gray rows of the page from row m_iGrayTop on
+	uint32_t m_iGrayTop = 0;
+	uint32_t m_iGrayRows = 0;
+	uint32_t m_iGrayCapacity = 0;
+	uint32_t m_iDone = 0;				//rows already handed on
+	std::vector<unsigned char> m_vBits;	//bit rows of the rows in work, from row m_iDone on
+	size_t m_iBitStride = 0;
+
+	//integral images of a band, (rows + 1) x (width + 1) sums of the gray values and of their squares
+	typedef struct BandSums
+	{
+		std::vector<uint64_t> _vSum;
+		std::vector<uint64_t> _vSquares;
+	}BandSums;
+
+	std::vector<BandSums> m_vSums;		//one per thread, kept from batch to batch of the page
+
+	//error diffusion carries the error of the last rows and the progress of every row in flight from batch to batch,
+	//in rings of a row per thread and 2 more
+	unsigned m_iDitherThreads = 1;
+	uint32_t m_iErrorRows = 0;
+	size_t m_iErrorStride = 0;
+	std::vector<int32_t> m_vError;
+	std::unique_ptr<std::atomic<uint64_t>[]> m_pProgress;
+
+	unsigned GetThreads(uint32_t iUnits);
+	bool IsDither() const;
+	const unsigned char* GetGrayRow(uint32_t y) const;
+	unsigned char* GetBitRow(uint32_t y);
+	bool Process();
+	void Dither(uint32_t iEnd);
+	void BinarizeBand(uint32_t iTop, uint32_t iBottom, BandSums& sums);
+
+public:
+	//iWindow is the width(and height) of the window in pixels, iThreads 0 uses a thread per core.
+	//the window and k are not used for error diffusion
+	CTiffBinarizer(m_eMethod eMethod, uint32_t iWindow, double dK, unsigned iThreads = 0);
+	~CTiffBinarizer() = default;
+
+	//avoid copying of this objects
+	CTiffBinarizer(const CTiffBinarizer& second) = delete;
+
+	//starts a page. fnRows gets its 1 bit pixels packed as CTiffPixelKernels::PackBits does, the bit is set for black
+	void Begin(uint32_t iWidth, uint32_t iHeight, const RowsFunction& fnRows);
+
+	//adds the next 8 bit gray rows of the page, the rows that are final are handed to fnRows.
+	//the last row of the page hands on the rest
+	bool AddRows(const unsigned char* pGray, size_t iGrayStride, uint32_t iRows);
+};
@@ -0,0 +1,800 @@
+#include "TiffIFDChain.h"
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//strip data is moved in blocks of this size
+static const size_t COPY_BLOCK_SIZE = 4 * 1024 * 1024;
+
+//a directory with more tags than this is treated as corrupt
+static const uint64_t MAX_IFD_ENTRIES = 4096;
+
+CTiffIFDChain::~CTiffIFDChain()
+{
+	Close();
+}
+
+//PRIVATE MEMBERS
+uint64_t CTiffIFDChain::GetValue(const unsigned char* pBytes, int iSize) const
+{
+	uint64_t iValue = 0;
+
+	for (int i = 0; i < iSize; i++)
+	{
+		if (m_bBigEndian)
+			iValue = (iValue << 8) | pBytes[i];
+		else
+			iValue |= (uint64_t)pBytes[i] << (8 * i);
+	}
+
+	return iValue;
+}
+
+void CTiffIFDChain::PutValue(unsigned char* pBytes, uint64_t iValue, int iSize) const
+{
+	for (int i = 0; i < iSize; i++)
+	{
+		int iShift = m_bBigEndian ? 8 * (iSize - 1 - i) : 8 * i;
+		pBytes[i] = (unsigned char)(iValue >> iShift);
+	}
+}
+
+int CTiffIFDChain::GetTypeSize(uint16_t iType) const
+{
+	switch (iType)
+	{
+	case TIFF_BYTE:
+	case TIFF_ASCII:
+	case TIFF_SBYTE:
+	case TIFF_UNDEFINED:
+		return 1;
+	case TIFF_SHORT:
+	case TIFF_SSHORT:
+		return 2;
+	case TIFF_LONG:
+	case TIFF_SLONG:
+	case TIFF_FLOAT:
+	case TIFF_IFD:
+		return 4;
+	case TIFF_RATIONAL:
+	case TIFF_SRATIONAL:
+	case TIFF_DOUBLE:
+	case TIFF_LONG8:
+	case TIFF_SLONG8:
+	case TIFF_IFD8:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+int CTiffIFDChain::GetOffsetSize() const
+{
+	return m_bBigTIFF ? 8 : 4;
+}
+
+int CTiffIFDChain::GetEntrySize() const
+{
+	return m_bBigTIFF ? 20 : 12;
+}
+
+uint64_t CTiffIFDChain::GetNextPointerPos(uint32_t pageno) const
+{
+	//the next-IFD pointer follows the tag count and the tag entries
+	return m_vOffsets[pageno] + (m_bBigTIFF ? 8 : 2) + m_vEntryCounts[pageno] * GetEntrySize();
+}
+
+bool CTiffIFDChain::ReadAt(uint64_t iOffset, void* pBuffer, size_t iSize)
+{
+	if (_fseeki64(m_pFile, (int64_t)iOffset, SEEK_SET) != 0)
+		return false;
+
+	return (fread(pBuffer, 1, iSize, m_pFile) == iSize);
+}
+
+bool CTiffIFDChain::ReadEntries(uint64_t iOffset, std::vector<IFDEntry>& vEntries)
+{
+	unsigned char countBytes[8];
+	int iCountSize = m_bBigTIFF ? 8 : 2;
+
+	if (!ReadAt(iOffset, countBytes, iCountSize))
+		return false;
+
+	uint64_t iCount = GetValue(countBytes, iCountSize);
+	if (iCount > MAX_IFD_ENTRIES)
+		return false;
+
+	std::vector<unsigned char> vBytes((size_t)iCount * GetEntrySize());
+	if (!vBytes.empty() && (fread(vBytes.data(), 1, vBytes.size(), m_pFile) != vBytes.size()))
+		return false;
+
+	vEntries.resize((size_t)iCount);
+
+	for (size_t i = 0; i < vEntries.size(); i++)
+	{
+		const unsigned char* pEntry = &vBytes[i * GetEntrySize()];
+		IFDEntry& entry = vEntries[i];
+
+		entry._tag = (uint16_t)GetValue(pEntry, 2);
+		entry._type = (uint16_t)GetValue(pEntry + 2, 2);
+		entry._count = GetValue(pEntry + 4, m_bBigTIFF ? 8 : 4);
+
+		memset(entry._value, 0, sizeof(entry._value));
+		memcpy(entry._value, pEntry + (m_bBigTIFF ? 12 : 8), GetOffsetSize());
+	}
+
+	return true;
+}
+
+bool CTiffIFDChain::GetDataSize(const IFDEntry& entry, uint64_t& iSize) const
+{
+	//the count of a corrupt entry may ask for more bytes than the file has, or overflow the size
+	int iTypeSize = GetTypeSize(entry._type);
+	if ((iTypeSize == 0) || (entry._count > m_iFileSize / iTypeSize))
+		return false;
+
+	iSize = entry._count * iTypeSize;
+	return true;
+}
+
+bool CTiffIFDChain::ReadArray(const IFDEntry& entry, std::vector<uint64_t>& vValues)
+{
+	int iTypeSize = GetTypeSize(entry._type);
+	uint64_t iDataSize = 0;
+	if (((entry._type != TIFF_SHORT) && (entry._type != TIFF_LONG) && (entry._type != TIFF_LONG8)) || !GetDataSize(entry, iDataSize))
+		return false;
+
+	std::vector<unsigned char> vBytes((size_t)iDataSize);
+
+	//small arrays are stored in the value field itself
+	if (vBytes.size() <= (size_t)GetOffsetSize())
+		memcpy(vBytes.data(), entry._value, vBytes.size());
+	else if (!ReadAt(GetValue(entry._value, GetOffsetSize()), vBytes.data(), vBytes.size()))
+		return false;
+
+	vValues.resize((size_t)entry._count);
+	for (size_t i = 0; i < vValues.size(); i++)
+		vValues[i] = GetValue(&vBytes[i * iTypeSize], iTypeSize);
+
+	return true;
+}
+
+bool CTiffIFDChain::CopyBytes(uint64_t iOffset, uint64_t iSize, FILE* pOutfile)
+{
+	if (m_vCopyBuffer.empty())
+		m_vCopyBuffer.resize(COPY_BLOCK_SIZE);
+
+	if (_fseeki64(m_pFile, (int64_t)iOffset, SEEK_SET) != 0)
+		return false;
+
+	while (iSize > 0)
+	{
+		size_t iBlock = (size_t)std::min<uint64_t>(iSize, m_vCopyBuffer.size());
+
+		if (fread(m_vCopyBuffer.data(), 1, iBlock, m_pFile) != iBlock)
+			return false;
+		if (fwrite(m_vCopyBuffer.data(), 1, iBlock, pOutfile) != iBlock)
+			return false;
+
+		iSize -= iBlock;
+	}
+
+	return true;
+}
+
+bool CTiffIFDChain::AlignOutput(FILE* pOutfile, uint64_t& iPos)
+{
+	//TIFF wants directories and values on word boundaries
+	if (iPos & 1)
+	{
+		if (fputc(0, pOutfile) == EOF)
+			return false;
+		iPos++;
+	}
+
+	//a classic TIFF cant address anything beyond 4GB
+	return (m_bBigTIFF || (iPos <= 0xFFFFFFFF));
+}
+
+bool CTiffIFDChain::WriteHeader(FILE* pOutfile)
+{
+	unsigned char header[16] = { 0 };
+	int iSize = m_bBigTIFF ? 16 : 8;
+
+	header[0] = header[1] = m_bBigEndian ? 'M' : 'I';
+	PutValue(header + 2, m_bBigTIFF ? 43 : 42, 2);
+	if (m_bBigTIFF)
+		PutValue(header + 4, 8, 2);
+
+	//the first IFD offset is patched once the first page is written
+	return (fwrite(header, 1, iSize, pOutfile) == (size_t)iSize);
+}
+
+bool CTiffIFDChain::WritePointer(FILE* pOutfile, uint64_t iPos, uint64_t iValue)
+{
+	unsigned char bytes[8];
+	PutValue(bytes, iValue, GetOffsetSize());
+
+	if (_fseeki64(pOutfile, (int64_t)iPos, SEEK_SET) != 0)
+		return false;
+
+	return (fwrite(bytes, 1, GetOffsetSize(), pOutfile) == (size_t)GetOffsetSize());
+}
+
+bool CTiffIFDChain::Truncate(uint64_t iSize)
+{
+	if (fflush(m_pFile) != 0)
+		return false;
+
+#ifdef _WIN32
+	return (_chsize_s(_fileno(m_pFile), (__int64)iSize) == 0);
+#else
+	return (ftruncate(fileno(m_pFile), (off_t)iSize) == 0);
+#endif
+}
+
+bool CTiffIFDChain::CopyIFD(uint64_t iOffset, FILE* pOutfile, uint64_t& iNewOffset, uint64_t& iNextPointerPos)
+{
+	std::vector<IFDEntry> vEntries;
+	if (!ReadEntries(iOffset, vEntries))
+	{
+		m_strErrorMsg = "Error reading the directory at offset " + std::to_string(iOffset);
+		return false;
+	}
+
+	IFDEntry* pOffsets = nullptr;
+	IFDEntry* pByteCounts = nullptr;
+
+	for (auto& entry : vEntries)
+	{
+		switch (entry._tag)
+		{
+		case TIFFTAG_STRIPOFFSETS:
+		case TIFFTAG_TILEOFFSETS:
+			pOffsets = &entry;
+			break;
+		case TIFFTAG_STRIPBYTECOUNTS:
+		case TIFFTAG_TILEBYTECOUNTS:
+			pByteCounts = &entry;
+			break;
+		case TIFFTAG_JPEGIFOFFSET:
+		case TIFFTAG_JPEGQTABLES:
+		case TIFFTAG_JPEGDCTABLES:
+		case TIFFTAG_JPEGACTABLES:
+		case TIFFTAG_FREEOFFSETS:
+			//these point into the file in ways we cant relocate
+			m_strErrorMsg = "Page has file offsets that cant be relocated(tag " + std::to_string(entry._tag) + ")";
+			return false;
+		}
+	}
+
+	std::vector<uint64_t> vOffsets, vByteCounts;
+	if (!pOffsets || !pByteCounts || !ReadArray(*pOffsets, vOffsets) || !ReadArray(*pByteCounts, vByteCounts) ||
+		(vOffsets.size() != vByteCounts.size()))
+	{
+		m_strErrorMsg = "Error reading the strip offsets of the directory at offset " + std::to_string(iOffset);
+		return false;
+	}
+
+	if (_fseeki64(pOutfile, 0, SEEK_END) != 0)
+	{
+		m_strErrorMsg = "Error writing the data to destination!!";
+		return false;
+	}
+
+	uint64_t iPos = (uint64_t)_ftelli64(pOutfile);
+	if (!AlignOutput(pOutfile, iPos))
+	{
+		m_strErrorMsg = "Output exceeds the 4GB limit of a classic TIFF file";
+		return false;
+	}
+
+	//copy the image data first. strips that follow each other in the source are moved in one go
+	std::vector<uint64_t> vNewOffsets(vOffsets.size(), 0);
+
+	for (size_t i = 0; i < vOffsets.size();)
+	{
+		if (vByteCounts[i] == 0)
+		{
+			i++;
+			continue;
+		}
+
+		size_t iEnd = i + 1;
+		uint64_t iRunSize = vByteCounts[i];
+
+		while ((iEnd < vOffsets.size()) && (vByteCounts[iEnd] > 0) && (vOffsets[iEnd] == vOffsets[iEnd - 1] + vByteCounts[iEnd - 1]))
+		{
+			iRunSize += vByteCounts[iEnd];
+			iEnd++;
+		}
+
+		for (size_t strip = i; strip < iEnd; strip++)
+			vNewOffsets[strip] = iPos + (vOffsets[strip] - vOffsets[i]);
+
+		if (!CopyBytes(vOffsets[i], iRunSize, pOutfile))
+		{
+			m_strErrorMsg = "Error copying the image data of the directory at offset " + std::to_string(iOffset);
+			return false;
+		}
+
+		iPos += iRunSize;
+		i = iEnd;
+	}
+
+	//copy the values that dont fit into their tag entries and build the new directory
+	std::vector<IFDEntry> vNewEntries;
+
+	for (auto& entry : vEntries)
+	{
+		//pointers to private directories(EXIF, GPS, SubIFDs) are dropped, like libtiff does when copying pages
+		if ((entry._type == TIFF_IFD) || (entry._type == TIFF_IFD8) || (entry._tag == TIFFTAG_SUBIFD) ||
+			(entry._tag == TIFFTAG_EXIFIFD) || (entry._tag == TIFFTAG_GPSIFD) || (entry._tag == TIFFTAG_INTEROPERABILITYIFD))
+			continue;
+
+		IFDEntry newEntry = entry;
+		int iTypeSize = GetTypeSize(entry._type);
+		if (iTypeSize == 0)
+		{
+			m_strErrorMsg = "Unknown field type " + std::to_string(entry._type) + " in tag " + std::to_string(entry._tag);
+			return false;
+		}
+
+		uint64_t iDataSize = 0;
+		if (!GetDataSize(entry, iDataSize))
+		{
+			m_strErrorMsg = "Invalid count " + std::to_string(entry._count) + " in tag " + std::to_string(entry._tag);
+			return false;
+		}
+
+		if (&entry == pOffsets)
+		{
+			std::vector<unsigned char> vBytes((size_t)iDataSize);
+			uint64_t iMaxValue = (iTypeSize == 2) ? 0xFFFF : ((iTypeSize == 4) ? 0xFFFFFFFF : UINT64_MAX);
+
+			for (size_t strip = 0; strip < vNewOffsets.size(); strip++)
+			{
+				if (vNewOffsets[strip] > iMaxValue)
+				{
+					m_strErrorMsg = "Strip offsets dont fit into the offsets field";
+					return false;
+				}
+				PutValue(&vBytes[strip * iTypeSize], vNewOffsets[strip], iTypeSize);
+			}
+
+			if (iDataSize <= (uint64_t)GetOffsetSize())
+			{
+				memset(newEntry._value, 0, sizeof(newEntry._value));
+				memcpy(newEntry._value, vBytes.data(), vBytes.size());
+			}
+			else
+			{
+				if (!AlignOutput(pOutfile, iPos) || (fwrite(vBytes.data(), 1, vBytes.size(), pOutfile) != vBytes.size()))
+				{
+					m_strErrorMsg = "Error writing the strip offsets to destination!!";
+					return false;
+				}
+				PutValue(newEntry._value, iPos, GetOffsetSize());
+				iPos += iDataSize;
+			}
+		}
+		else if (iDataSize > (uint64_t)GetOffsetSize())
+		{
+			if (!AlignOutput(pOutfile, iPos) || !CopyBytes(GetValue(entry._value, GetOffsetSize()), iDataSize, pOutfile))
+			{
+				m_strErrorMsg = "Error copying tag " + std::to_string(entry._tag) + " of the directory at offset " + std::to_string(iOffset);
+				return false;
+			}
+			PutValue(newEntry._value, iPos, GetOffsetSize());
+			iPos += iDataSize;
+		}
+
+		vNewEntries.push_back(newEntry);
+	}
+
+	//the directory itself goes last, its next pointer is patched when the next page is written
+	int iCountSize = m_bBigTIFF ? 8 : 2;
+	std::vector<unsigned char> vIFD(iCountSize + vNewEntries.size() * GetEntrySize() + GetOffsetSize(), 0);
+
+	PutValue(vIFD.data(), vNewEntries.size(), iCountSize);
+	for (size_t i = 0; i < vNewEntries.size(); i++)
+	{
+		unsigned char* pEntry = &vIFD[iCountSize + i * GetEntrySize()];
+		PutValue(pEntry, vNewEntries[i]._tag, 2);
+		PutValue(pEntry + 2, vNewEntries[i]._type, 2);
+		PutValue(pEntry + 4, vNewEntries[i]._count, m_bBigTIFF ? 8 : 4);
+		memcpy(pEntry + (m_bBigTIFF ? 12 : 8), vNewEntries[i]._value, GetOffsetSize());
+	}
+
+	if (!AlignOutput(pOutfile, iPos))
+	{
+		m_strErrorMsg = "Output exceeds the 4GB limit of a classic TIFF file";
+		return false;
+	}
+
+	iNewOffset = iPos;
+	iNextPointerPos = iPos + vIFD.size() - GetOffsetSize();
+
+	if (fwrite(vIFD.data(), 1, vIFD.size(), pOutfile) != vIFD.size())
+	{
+		m_strErrorMsg = "Error writing the directory to destination!!";
+		return false;
+	}
+
+	return true;
+}
+
+//PUBLIC MEMBERS
+bool CTiffIFDChain::Open(const std::string& strFile, bool bUpdate)
+{
+	Close();
+
+	fopen_s(&m_pFile, strFile.c_str(), bUpdate ? "r+b" : "rb");
+	if (!m_pFile)
+	{
+		m_strErrorMsg = "Error opening input file: " + strFile;
+		return false;
+	}
+
+	unsigned char header[16];
+	if (fread(header, 1, 8, m_pFile) != 8)
+	{
+		m_strErrorMsg = "Not a TIFF file: " + strFile;
+		return false;
+	}
+
+	if ((header[0] == 'I') && (header[1] == 'I'))
+		m_bBigEndian = false;
+	else if ((header[0] == 'M') && (header[1] == 'M'))
+		m_bBigEndian = true;
+	else
+	{
+		m_strErrorMsg = "Not a TIFF file: " + strFile;
+		return false;
+	}
+
+	uint16_t iVersion = (uint16_t)GetValue(header + 2, 2);
+	m_bBigTIFF = (iVersion == 43);
+	m_bDamaged = false;
+
+	if (!GetFileSize(m_iFileSize) || (_fseeki64(m_pFile, 8, SEEK_SET) != 0))
+	{
+		m_strErrorMsg = "Error reading file: " + strFile;
+		return false;
+	}
+
+	if (m_bBigTIFF && (fread(header + 8, 1, 8, m_pFile) != 8))
+	{
+		m_strErrorMsg = "Not a TIFF file: " + strFile;
+		return false;
+	}
+	else if (!m_bBigTIFF && (iVersion != 42))
+	{
+		m_strErrorMsg = "Not a TIFF file: " + strFile;
+		return false;
+	}
+
+	//walk the chain once, remembering where every directory starts and how many tags it has
+	std::set<uint64_t> sVisited;
+	uint64_t iOffset = m_bBigTIFF ? GetValue(header + 8, 8) : GetValue(header + 4, 4);
+	int iCountSize = m_bBigTIFF ? 8 : 2;
+
+	while (iOffset != 0)
+	{
+		unsigned char bytes[8];
+
+		if (!sVisited.insert(iOffset).second)
+		{
+			m_strErrorMsg = "IFD loop detected in: " + strFile;
+			return false;
+		}
+
+		if (!ReadAt(iOffset, bytes, iCountSize))
+		{
+			m_strErrorMsg = "Error reading the directory at offset " + std::to_string(iOffset);
+			return false;
+		}
+
+		m_vOffsets.push_back(iOffset);
+		m_vEntryCounts.push_back(GetValue(bytes, iCountSize));
+
+		if (!ReadAt(GetNextPointerPos((uint32_t)m_vOffsets.size() - 1), bytes, GetOffsetSize()))
+		{
+			m_strErrorMsg = "Error reading the directory at offset " + std::to_string(iOffset);
+			return false;
+		}
+
+		iOffset = GetValue(bytes, GetOffsetSize());
+	}
+
+	return true;
+}
+
+void CTiffIFDChain::Close()
+{
+	if (m_pFile)
+		fclose(m_pFile);
+
+	m_pFile = nullptr;
+	m_vOffsets.clear();
+	m_vEntryCounts.clear();
+}
+
+uint32_t CTiffIFDChain::GetPageCount() const
+{
+	return (uint32_t)m_vOffsets.size();
+}
+
+bool CTiffIFDChain::IsBigEndian() const
+{
+	return m_bBigEndian;
+}
+
+bool CTiffIFDChain::IsBigTIFF() const
+{
+	return m_bBigTIFF;
+}
+
+bool CTiffIFDChain::IsDamaged() const
+{
+	return m_bDamaged;
+}
+
+uint64_t CTiffIFDChain::GetChainEnd() const
+{
+	if (m_vOffsets.empty())
+		return m_bBigTIFF ? 8 : 4;
+
+	return GetNextPointerPos((uint32_t)m_vOffsets.size() - 1);
+}
+
+bool CTiffIFDChain::GetFileSize(uint64_t& iSize)
+{
+	if (!m_pFile || (_fseeki64(m_pFile, 0, SEEK_END) != 0))
+		return false;
+
+	int64_t iEnd = _ftelli64(m_pFile);
+	if (iEnd < 0)
+		return false;
+
+	iSize = (uint64_t)iEnd;
+	return true;
+}
+
+std::string CTiffIFDChain::GetErrorMsg()
+{
+	return m_strErrorMsg;
+}
+
+bool CTiffIFDChain::CopyPages(const std::vector<uint32_t>& vPages, const std::string& strOutfile)
+{
+	bool bRes = true;
+	FILE* pOutfile = nullptr;
+
+	fopen_s(&pOutfile, strOutfile.c_str(), "wb");
+	if (!pOutfile)
+	{
+		m_strErrorMsg = "Error creating output file: " + strOutfile;
+		return false;
+	}
+
+	//the first pointer to patch is the first IFD offset in the header
+	uint64_t iPointerPos = m_bBigTIFF ? 8 : 4;
+	bRes = WriteHeader(pOutfile);
+
+	for (size_t i = 0; bRes && (i < vPages.size()); i++)
+	{
+		uint64_t iNewOffset = 0, iNextPointerPos = 0;
+
+		if (vPages[i] >= m_vOffsets.size())
+		{
+			m_strErrorMsg = "Invalid page number: " + std::to_string(vPages[i] + 1);
+			bRes = false;
+			break;
+		}
+
+		bRes = CopyIFD(m_vOffsets[vPages[i]], pOutfile, iNewOffset, iNextPointerPos);
+
+		if (bRes && !WritePointer(pOutfile, iPointerPos, iNewOffset))
+		{
+			m_strErrorMsg = "Error writing the IFD chain!!";
+			bRes = false;
+		}
+
+		iPointerPos = iNextPointerPos;
+	}
+
+	if (fclose(pOutfile) != 0)
+		bRes = false;
+
+	return bRes;
+}
+
+bool CTiffIFDChain::UnlinkPages(const std::set<uint32_t>& sPages)
+{
+	std::vector<uint32_t> vKeep;
+
+	for (uint32_t pageno = 0; pageno < m_vOffsets.size(); pageno++)
+	{
+		if (sPages.find(pageno) == sPages.end())
+			vKeep.push_back(pageno);
+	}
+
+	//only the pointers that change are written, the header first and then every surviving IFD.
+	//removing every page leaves a file without directories, same as the other removal modes
+	std::vector<PointerChange> vChanges;
+	uint64_t iHeaderPointerPos = m_bBigTIFF ? 8 : 4;
+	uint64_t iFirstOffset = vKeep.empty() ? 0 : m_vOffsets[vKeep[0]];
+
+	if (!m_vOffsets.empty() && (iFirstOffset != m_vOffsets[0]))
+		vChanges.push_back({ iHeaderPointerPos, m_vOffsets[0], iFirstOffset });
+
+	for (size_t i = 0; i < vKeep.size(); i++)
+	{
+		uint32_t pageno = vKeep[i];
+		uint64_t iOldNext = (pageno + 1 < m_vOffsets.size()) ? m_vOffsets[pageno + 1] : 0;
+		uint64_t iNewNext = (i + 1 < vKeep.size()) ? m_vOffsets[vKeep[i + 1]] : 0;
+
+		if (iOldNext != iNewNext)
+			vChanges.push_back({ GetNextPointerPos(pageno), iOldNext, iNewNext });
+	}
+
+	bool bRes = true;
+	size_t iTried = 0;
+	for (; bRes && (iTried < vChanges.size()); iTried++)
+		bRes = WritePointer(m_pFile, vChanges[iTried]._pos, vChanges[iTried]._new);
+
+	bRes = bRes && (fflush(m_pFile) == 0);
+
+	//a failed write puts the pointers tried before back, so the file keeps all of its pages
+	if (!bRes)
+	{
+		bool bRestored = true;
+		while (iTried-- > 0)
+			bRestored = WritePointer(m_pFile, vChanges[iTried]._pos, vChanges[iTried]._old) && bRestored;
+
+		m_bDamaged = !bRestored || (fflush(m_pFile) != 0);
+		m_strErrorMsg = m_bDamaged ? "Error writing the IFD chain, the file may have lost pages!!" : "Error writing the IFD chain!!";
+		return false;
+	}
+
+	//keep the chain in sync with the file
+	std::vector<uint64_t> vOffsets, vEntryCounts;
+	for (auto pageno : vKeep)
+	{
+		vOffsets.push_back(m_vOffsets[pageno]);
+		vEntryCounts.push_back(m_vEntryCounts[pageno]);
+	}
+	m_vOffsets.swap(vOffsets);
+	m_vEntryCounts.swap(vEntryCounts);
+
+	return true;
+}
+
+bool CTiffIFDChain::AppendFiles(const std::vector<std::string>& vFiles)
+{
+	//every source is checked before anything is written, a file that cant be appended
+	//leaves this file as it is and the caller can fall back to a decode merge
+	for (auto& strFile : vFiles)
+	{
+		CTiffIFDChain sourceChain;
+
+		if (!sourceChain.Open(strFile))
+		{
+			m_strErrorMsg = sourceChain.GetErrorMsg();
+			return false;
+		}
+
+		if ((sourceChain.m_bBigEndian != m_bBigEndian) || (sourceChain.m_bBigTIFF != m_bBigTIFF))
+		{
+			m_strErrorMsg = "Byte order or TIFF format of " + strFile + " doesnt match the destination";
+			return false;
+		}
+	}
+
+	if (_fseeki64(m_pFile, 0, SEEK_END) != 0)
+	{
+		m_strErrorMsg = "Error writing the data to destination!!";
+		return false;
+	}
+
+	uint64_t iEndOfFile = (uint64_t)_ftelli64(m_pFile);
+	uint64_t iFirstNewOffset = 0;
+	uint64_t iPointerPos = 0;
+	std::vector<uint64_t> vNewOffsets, vNewEntryCounts;
+	bool bRes = true;
+
+	for (size_t i = 0; bRes && (i < vFiles.size()); i++)
+	{
+		CTiffIFDChain sourceChain;
+
+		if (!sourceChain.Open(vFiles[i]))
+		{
+			m_strErrorMsg = sourceChain.GetErrorMsg();
+			bRes = false;
+			break;
+		}
+
+		for (uint32_t pageno = 0; pageno < sourceChain.GetPageCount(); pageno++)
+		{
+			uint64_t iNewOffset = 0, iNextPointerPos = 0;
+
+			if (!sourceChain.CopyIFD(sourceChain.m_vOffsets[pageno], m_pFile, iNewOffset, iNextPointerPos))
+			{
+				m_strErrorMsg = sourceChain.GetErrorMsg();
+				bRes = false;
+				break;
+			}
+
+			//the appended pages are chained among themselves first
+			if ((iPointerPos != 0) && !WritePointer(m_pFile, iPointerPos, iNewOffset))
+			{
+				m_strErrorMsg = "Error writing the IFD chain!!";
+				bRes = false;
+				break;
+			}
+
+			if (iFirstNewOffset == 0)
+				iFirstNewOffset = iNewOffset;
+
+			iPointerPos = iNextPointerPos;
+			vNewOffsets.push_back(iNewOffset);
+			vNewEntryCounts.push_back((iNextPointerPos - iNewOffset - (m_bBigTIFF ? 8 : 2)) / GetEntrySize());
+		}
+	}
+
+	if (bRes && (iFirstNewOffset == 0))
+		return true;
+
+	//the new pages are linked to the file only when all of them are written,
+	//so a failure above leaves the pages already in the file untouched
+	uint64_t iLastPointerPos = m_vOffsets.empty() ? (m_bBigTIFF ? 8 : 4) : GetNextPointerPos(GetPageCount() - 1);
+
+	if (bRes && (!WritePointer(m_pFile, iLastPointerPos, iFirstNewOffset) || (fflush(m_pFile) != 0)))
+	{
+		m_strErrorMsg = "Error writing the IFD chain!!";
+		WritePointer(m_pFile, iLastPointerPos, 0);
+		bRes = false;
+	}
+
+	//the bytes already copied are cut off again
+	if (!bRes)
+	{
+		Truncate(iEndOfFile);
+		return false;
+	}
+
+	m_vOffsets.insert(m_vOffsets.end(), vNewOffsets.begin(), vNewOffsets.end());
+	m_vEntryCounts.insert(m_vEntryCounts.end(), vNewEntryCounts.begin(), vNewEntryCounts.end());
+
+	return true;
+}
+
+bool CTiffIFDChain::CutBack(const std::string& strFile, uint64_t iSize, uint64_t iChainEnd)
+{
+	//the chain past iChainEnd may be broken, so the file is opened without walking it
+	Close();
+
+	unsigned char header[4];
+	fopen_s(&m_pFile, strFile.c_str(), "r+b");
+	if (!m_pFile || (fread(header, 1, 4, m_pFile) != 4))
+	{
+		m_strErrorMsg = "Error opening input file: " + strFile;
+		Close();
+		return false;
+	}
+
+	m_bBigEndian = (header[0] == 'M');
+	m_bBigTIFF = (GetValue(header + 2, 2) == 43);
+
+	bool bRes = WritePointer(m_pFile, iChainEnd, 0) && Truncate(iSize);
+	if (!bRes)
+		m_strErrorMsg = "Error cutting back file: " + strFile;
+
+	Close();
+	return bRes;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "tiff.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <cstdint>
+
+//byte level access to the IFD chain of a TIFF file.
+//pages are removed or copied by rewriting their directories and moving the strip bytes as they are,
+//the image data is never decoded and libtiff is not involved.
+class CTiffIFDChain
+{
+private:
+	typedef struct IFDEntry
+	{
+		uint16_t _tag;
+		uint16_t _type;
+		uint64_t _count;
+		unsigned char _value[8];	//inline value or offset of the value, in file byte order
+	}IFDEntry;
+
+	//a pointer of the chain rewritten by UnlinkPages
+	typedef struct PointerChange
+	{
+		uint64_t _pos;
+		uint64_t _old;
+		uint64_t _new;
+	}PointerChange;
+
+	FILE* m_pFile = nullptr;
+	bool m_bBigEndian = false;
+	bool m_bBigTIFF = false;
+	bool m_bDamaged = false;				//a failed UnlinkPages couldnt put the chain back
+	uint64_t m_iFileSize = 0;				//size of the file when it was opened
+	std::vector<uint64_t> m_vOffsets;		//IFD offset of every page
+	std::vector<uint64_t> m_vEntryCounts;	//number of tags in every IFD
+	std::vector<unsigned char> m_vCopyBuffer;
+	std::string m_strErrorMsg = "";
+
+	uint64_t GetValue(const unsigned char* pBytes, int iSize) const;
+	void PutValue(unsigned char* pBytes, uint64_t iValue, int iSize) const;
+	int GetTypeSize(uint16_t iType) const;
+	int GetOffsetSize() const;
+	int GetEntrySize() const;
+	uint64_t GetNextPointerPos(uint32_t pageno) const;
+
+	bool ReadAt(uint64_t iOffset, void* pBuffer, size_t iSize);
+	bool ReadEntries(uint64_t iOffset, std::vector<IFDEntry>& vEntries);
+	bool GetDataSize(const IFDEntry& entry, uint64_t& iSize) const;
+	bool ReadArray(const IFDEntry& entry, std::vector<uint64_t>& vValues);
+	bool CopyBytes(uint64_t iOffset, uint64_t iSize, FILE* pOutfile);
+	bool AlignOutput(FILE* pOutfile, uint64_t& iPos);
+	bool WriteHeader(FILE* pOutfile);
+	bool WritePointer(FILE* pOutfile, uint64_t iPos, uint64_t iValue);
+	bool Truncate(uint64_t iSize);
+	bool CopyIFD(uint64_t iOffset, FILE* pOutfile, uint64_t& iNewOffset, uint64_t& iNextPointerPos);
+
+public:
+	CTiffIFDChain() = default;
+	~CTiffIFDChain();
+
+	//avoid copying of this objects
+	CTiffIFDChain(const CTiffIFDChain& second) = delete;
+
+	//reads the header and walks the IFD chain, bUpdate opens the file for in-place changes
+	bool Open(const std::string& strFile, bool bUpdate = false);
+	void Close();
+
+	uint32_t GetPageCount() const;
+	bool IsBigEndian() const;
+	bool IsBigTIFF() const;
+	bool GetFileSize(uint64_t& iSize);
+	bool IsDamaged() const;
+
+	//position of the next-IFD pointer that ends the chain(the first IFD offset for a file without pages)
+	uint64_t GetChainEnd() const;
+	std::string GetErrorMsg();
+
+	//writes the given pages(zero based, in the given order) to a new file.
+	//each page costs one directory rewrite and a few large sequential copies of its strip bytes
+	bool CopyPages(const std::vector<uint32_t>& vPages, const std::string& strOutfile);
+
+	//removes pages(zero based) by relinking the next-IFD pointers of the file in place.
+	//the removed pages stay in the file as unused bytes until the file is rewritten with CopyPages.
+	//on failure the old pointers are written back, IsDamaged tells if that failed too
+	bool UnlinkPages(const std::set<uint32_t>& sPages);
+
+	//appends all the pages of the given files to this file(opened with bUpdate).
+	//strip bytes and directories are added at the end and linked to the last page, nothing already in the file is rewritten.
+	//the files must have the same byte order and format(classic or BigTIFF) as this file.
+	//on failure the file is cut back to the size it had before
+	bool AppendFiles(const std::vector<std::string>& vFiles);
+
+	//cuts a file back to iSize and ends its chain at iChainEnd again, for pages appended to it by libtiff.
+	//the file must not be open anywhere else
+	bool CutBack(const std::string& strFile, uint64_t iSize, uint64_t iChainEnd);
+};
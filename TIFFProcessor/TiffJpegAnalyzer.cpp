@@ -0,0 +1,363 @@
+#include "TiffJpegAnalyzer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+CTiffJpegAnalyzer::~CTiffJpegAnalyzer()
+{
+	if (m_bCreated)
+		jpeg_destroy_decompress(&m_Info);
+}
+
+bool CTiffJpegAnalyzer::Open(TIFF* pFile)
+{
+	uint16 iCompression = COMPRESSION_NONE, iPhotometric = 0, iPlanar = PLANARCONFIG_CONTIG;
+	uint32 iTablesSize = 0;
+	void* pTables = nullptr;
+
+	m_pFile = pFile;
+
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_COMPRESSION, &iCompression);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_PLANARCONFIG, &iPlanar);
+	TIFFGetField(pFile, TIFFTAG_PHOTOMETRIC, &iPhotometric);
+
+	if ((iCompression != COMPRESSION_JPEG) || (iPlanar != PLANARCONFIG_CONTIG))
+	{
+		m_strErrorMsg = "Only JPEG pages with interleaved samples can be analyzed!!";
+		return false;
+	}
+
+	//component 0 of YCbCr pages is the luma, the others are chroma. the components of
+	//other pages are the samples themselves
+	m_bYCbCr = (iPhotometric == PHOTOMETRIC_YCBCR);
+	m_bTiled = (TIFFIsTiled(pFile) != 0);
+	TIFFGetField(pFile, TIFFTAG_IMAGEWIDTH, &m_iWidth);
+	TIFFGetField(pFile, TIFFTAG_IMAGELENGTH, &m_iHeight);
+
+	if (m_bTiled)
+	{
+		TIFFGetField(pFile, TIFFTAG_TILEWIDTH, &m_iChunkWidth);
+		TIFFGetField(pFile, TIFFTAG_TILELENGTH, &m_iChunkLength);
+		m_iChunkCount = TIFFNumberOfTiles(pFile);
+	}
+	else
+	{
+		m_iChunkWidth = m_iWidth;
+		m_iChunkLength = m_iHeight;
+		TIFFGetFieldDefaulted(pFile, TIFFTAG_ROWSPERSTRIP, &m_iChunkLength);
+		m_iChunkLength = std::min(std::max(m_iChunkLength, (uint32_t)1), std::max(m_iHeight, (uint32_t)1));
+		m_iChunkCount = TIFFNumberOfStrips(pFile);
+	}
+
+	if ((m_iChunkWidth == 0) || (m_iChunkLength == 0) || (m_iChunkCount == 0))
+	{
+		m_strErrorMsg = "Invalid page layout!!";
+		return false;
+	}
+
+	if (!m_bCreated)
+	{
+		m_Info.err = jpeg_std_error(&m_Error._mgr);
+		m_Error._mgr.error_exit = ErrorExit;
+		m_Error._mgr.output_message = OutputMessage;
+
+		if (setjmp(m_Error._jmp))
+		{
+			m_strErrorMsg = "Error creating the JPEG decoder!!";
+			return false;
+		}
+
+		jpeg_create_decompress(&m_Info);
+		m_bCreated = true;
+
+		m_Source.init_source = InitSource;
+		m_Source.fill_input_buffer = FillInputBuffer;
+		m_Source.skip_input_data = SkipInputData;
+		m_Source.resync_to_restart = jpeg_resync_to_restart;
+		m_Source.term_source = TermSource;
+		m_Info.src = &m_Source;
+	}
+
+	//the strips of a page are abbreviated JPEG streams, their tables are in JPEGTABLES.
+	//the decoder keeps the tables for all the streams read after them
+	m_vTables.clear();
+	if (TIFFGetField(pFile, TIFFTAG_JPEGTABLES, &iTablesSize, &pTables) && pTables && (iTablesSize > 0))
+		m_vTables.assign((unsigned char*)pTables, (unsigned char*)pTables + iTablesSize);
+
+	if (!m_vTables.empty())
+	{
+		if (setjmp(m_Error._jmp))
+		{
+			jpeg_abort_decompress(&m_Info);
+			m_strErrorMsg = "Error reading the JPEG tables!!";
+			return false;
+		}
+
+		m_Source.next_input_byte = m_vTables.data();
+		m_Source.bytes_in_buffer = m_vTables.size();
+		jpeg_read_header(&m_Info, FALSE);
+	}
+
+	return true;
+}
+
+bool CTiffJpegAnalyzer::CheckBlank(int iTolerance, uint64_t iMaxInk, uint32_t iLeft, uint32_t iTop, uint32_t iRight, uint32_t iBottom, m_eVerdict& eResult)
+{
+	m_iLeft = iLeft;
+	m_iTop = iTop;
+	m_iRight = iRight;
+	m_iBottom = iBottom;
+	m_iTolerance = std::min(std::max(iTolerance, 0), 255);
+	m_iInk = 0;
+	m_bWhite = true;
+	m_bNeutral = true;
+	m_bColour = false;
+
+	eResult = m_eVerdict::UNDECIDED;
+
+	for (uint32_t chunk = 0; chunk < m_iChunkCount; chunk++)
+	{
+		if (!ReadChunk(chunk))
+			return false;
+
+		//enough ink for sure, the rest of the page doesnt matter
+		if (m_iInk > iMaxInk)
+		{
+			eResult = m_eVerdict::NO;
+			return true;
+		}
+	}
+
+	if (m_bWhite && m_bNeutral)
+		eResult = m_eVerdict::YES;
+
+	return true;
+}
+
+bool CTiffJpegAnalyzer::CheckGray(m_eVerdict& eResult)
+{
+	m_iLeft = 0;
+	m_iTop = 0;
+	m_iRight = m_iWidth;
+	m_iBottom = m_iHeight;
+	m_iTolerance = 0;
+	m_iInk = 0;
+	m_bWhite = true;
+	m_bNeutral = true;
+	m_bColour = false;
+
+	eResult = m_eVerdict::UNDECIDED;
+
+	//without chroma there is nothing to tell from the coefficients
+	if (!m_bYCbCr)
+		return true;
+
+	for (uint32_t chunk = 0; chunk < m_iChunkCount; chunk++)
+	{
+		if (!ReadChunk(chunk))
+			return false;
+
+		if (m_bColour)
+		{
+			eResult = m_eVerdict::NO;
+			return true;
+		}
+	}
+
+	if (m_bNeutral)
+		eResult = m_eVerdict::YES;
+
+	return true;
+}
+
+bool CTiffJpegAnalyzer::LoadChunk(uint32_t iChunk)
+{
+	uint64* pByteCounts = nullptr;
+
+	if (!TIFFGetField(m_pFile, m_bTiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &pByteCounts) || !pByteCounts)
+	{
+		m_strErrorMsg = "Missing strip byte counts!!";
+		return false;
+	}
+
+	m_vChunk.resize((size_t)pByteCounts[iChunk]);
+
+	tmsize_t iSize = m_bTiled ? TIFFReadRawTile(m_pFile, iChunk, m_vChunk.data(), (tmsize_t)m_vChunk.size())
+							  : TIFFReadRawStrip(m_pFile, iChunk, m_vChunk.data(), (tmsize_t)m_vChunk.size());
+	if (iSize <= 0)
+	{
+		m_strErrorMsg = "Error reading chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	m_vChunk.resize((size_t)iSize);
+	return true;
+}
+
+bool CTiffJpegAnalyzer::ReadChunk(uint32_t iChunk)
+{
+	if (!LoadChunk(iChunk))
+		return false;
+
+	if (setjmp(m_Error._jmp))
+	{
+		jpeg_abort_decompress(&m_Info);
+		m_strErrorMsg = "Error reading the DCT coefficients of chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	m_Source.next_input_byte = m_vChunk.data();
+	m_Source.bytes_in_buffer = m_vChunk.size();
+
+	if (jpeg_read_header(&m_Info, TRUE) != JPEG_HEADER_OK)
+	{
+		jpeg_abort_decompress(&m_Info);
+		m_strErrorMsg = "Invalid JPEG data in chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	//entropy decoding only, the coefficients of the whole chunk are kept by libjpeg
+	jvirt_barray_ptr* pCoefficients = jpeg_read_coefficients(&m_Info);
+	AnalyzeCoefficients(iChunk, pCoefficients);
+
+	//releases the coefficients but keeps the tables
+	jpeg_abort_decompress(&m_Info);
+	return true;
+}
+
+void CTiffJpegAnalyzer::AnalyzeCoefficients(uint32_t iChunk, jvirt_barray_ptr* pCoefficients)
+{
+	uint32_t iAcross = (m_iWidth + m_iChunkWidth - 1) / m_iChunkWidth;
+	uint32_t iChunkX = (iChunk % iAcross) * m_iChunkWidth;
+	uint32_t iChunkY = (iChunk / iAcross) * m_iChunkLength;
+
+	for (int ci = 0; ci < m_Info.num_components; ci++)
+	{
+		jpeg_component_info* pComponent = m_Info.comp_info + ci;
+		const UINT16* pQuant = pComponent->quant_table->quantval;
+		bool bChroma = m_bYCbCr && (ci > 0);
+
+		//size of a block in page pixels, chroma blocks of subsampled pages cover more than 8x8 pixels
+		uint32_t iBlockWidth = 8 * m_Info.max_h_samp_factor / pComponent->h_samp_factor;
+		uint32_t iBlockHeight = 8 * m_Info.max_v_samp_factor / pComponent->v_samp_factor;
+		uint32_t iPixelsPerSample = (iBlockWidth / 8) * (iBlockHeight / 8);
+
+		for (JDIMENSION by = 0; by < pComponent->height_in_blocks; by++)
+		{
+			uint32_t y = iChunkY + by * iBlockHeight;
+			if (y >= m_iHeight)
+				break;
+
+			JBLOCKARRAY pRow = (*m_Info.mem->access_virt_barray)((j_common_ptr)&m_Info, pCoefficients[ci], by, 1, FALSE);
+			bool bRowOverlaps = (y < m_iBottom) && (y + iBlockHeight > m_iTop);
+			bool bRowInside = (y >= m_iTop) && (y + iBlockHeight <= std::min(m_iBottom, m_iHeight));
+
+			for (JDIMENSION bx = 0; bx < pComponent->width_in_blocks; bx++)
+			{
+				uint32_t x = iChunkX + bx * iBlockWidth;
+				if (x >= m_iWidth)
+					break;
+
+				//the DC coefficient is 8 times the block mean - 128, the pixels of the block are
+				//at most a quarter of the summed up AC magnitudes away from the mean.
+				//all bounds below are scaled by 8 to stay in integers
+				JCOEFPTR pBlock = pRow[0][bx];
+				int iDC = pBlock[0] * pQuant[0];
+				int iAC = 0;
+
+				//a luma block inside the area counts the ink its mean needs, if its mean may be darker than white
+				bool bInside = !bChroma && bRowInside && (x >= m_iLeft) && (x + iBlockWidth <= std::min(m_iRight, m_iWidth));
+				bool bInkBlock = bInside && (iDC < 1012 - 8 * m_iTolerance);
+
+				//flat blocks(all AC 0) are the usual case on white paper, they are told apart with one pass of ORs.
+				//the AC sum is left out once the answers it could change are known
+				bool bSpread = bChroma ? (m_bNeutral || !m_bColour) : (m_bWhite || bInkBlock);
+				JCOEF iAnyAC = 0;
+
+				if (bSpread)
+				{
+					for (int k = 1; k < DCTSIZE2; k++)
+						iAnyAC |= pBlock[k];
+				}
+
+				if (iAnyAC != 0)
+				{
+					for (int k = 1; k < DCTSIZE2; k++)
+						iAC += std::abs(pBlock[k] * pQuant[k]);
+				}
+
+				//the integer IDCT of libjpeg puts the samples of a block with AC up to 1 off, flat blocks are exact
+				int iMargin = (iAC != 0) ? 8 : 0;
+
+				//chroma that rounds to 128 everywhere adds no colour to the pixels(offset + spread < 0.5)
+				if (bChroma)
+				{
+					if (std::abs(iDC) + 2 * iAC + iMargin >= 4)
+						m_bNeutral = false;
+					if (std::abs(iDC) - 2 * iAC - iMargin >= 12)
+						m_bColour = true;
+
+					continue;
+				}
+
+				if (!bRowOverlaps || (x >= m_iRight) || (x + iBlockWidth <= m_iLeft))
+					continue;
+
+				//the darkest pixel of the block may be ink(mean - spread < 254.5 - tolerance)
+				if (iDC - 2 * iAC < 1012 - 8 * m_iTolerance + iMargin)
+					m_bWhite = false;
+
+				//with n ink pixels at the darkest value of the block and the others just inside the tolerance,
+				//a mean below white needs n >= 64 * (white - mean) / (white - darkest).
+				//a dark luma makes at least one of R, G and B dark too
+				int iWhite = 1012 - 8 * m_iTolerance - iMargin;
+				if (bInkBlock && (iDC < iWhite))
+					m_iInk += (uint64_t)(DCTSIZE2 * (iWhite - iDC) / (iWhite - iDC + 2 * iAC)) * iPixelsPerSample;
+			}
+		}
+	}
+}
+
+void CTiffJpegAnalyzer::InitSource(j_decompress_ptr /*pInfo*/)
+{
+}
+
+boolean CTiffJpegAnalyzer::FillInputBuffer(j_decompress_ptr pInfo)
+{
+	//the whole stream is in memory, a truncated one is ended with an EOI marker
+	static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+	pInfo->src->next_input_byte = eoi;
+	pInfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
+
+void CTiffJpegAnalyzer::SkipInputData(j_decompress_ptr pInfo, long iBytes)
+{
+	if (iBytes <= 0)
+		return;
+
+	size_t iSkip = std::min((size_t)iBytes, pInfo->src->bytes_in_buffer);
+	pInfo->src->next_input_byte += iSkip;
+	pInfo->src->bytes_in_buffer -= iSkip;
+}
+
+void CTiffJpegAnalyzer::TermSource(j_decompress_ptr /*pInfo*/)
+{
+}
+
+void CTiffJpegAnalyzer::ErrorExit(j_common_ptr pInfo)
+{
+	JpegError* pError = (JpegError*)pInfo->err;
+	longjmp(pError->_jmp, 1);
+}
+
+void CTiffJpegAnalyzer::OutputMessage(j_common_ptr /*pInfo*/)
+{
+	//warnings of corrupt data are not printed, errors end in ErrorExit
+}
+
+std::string CTiffJpegAnalyzer::GetErrorMsg()
+{
+	return m_strErrorMsg;
+}
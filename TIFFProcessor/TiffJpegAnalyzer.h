@@ -0,0 +1,83 @@
+#pragma once
+#include "tiffio.h"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <csetjmp>
+#include <cstdint>
+#include "jpeglib.h"
+
+//classifies JPEG compressed pages from their DCT coefficients. the strips(or tiles) are only entropy decoded
+//with jpeg_read_coefficients, there is no IDCT, no upsampling and no colour conversion.
+//the block mean comes from the DC coefficient and the AC coefficients bound how far a pixel of the block
+//can be away from it, so every answer is either certain or UNDECIDED, in which case the pixels have to be looked at.
+class CTiffJpegAnalyzer
+{
+public:
+	typedef enum Verdict { UNDECIDED = 0, YES, NO } m_eVerdict;
+
+protected:
+	//libjpeg reports errors through error_exit, it must not return to libjpeg
+	typedef struct JpegError
+	{
+		struct jpeg_error_mgr _mgr;
+		jmp_buf _jmp;
+	}JpegError;
+
+	TIFF* m_pFile = nullptr;
+	bool m_bTiled = false;
+	bool m_bYCbCr = false;
+	uint32_t m_iWidth = 0;
+	uint32_t m_iHeight = 0;
+	uint32_t m_iChunkWidth = 0;
+	uint32_t m_iChunkLength = 0;
+	uint32_t m_iChunkCount = 0;
+
+	std::vector<unsigned char> m_vTables;	//JPEGTABLES of the page, shared by all of its strips
+	std::vector<unsigned char> m_vChunk;	//raw data of the current strip
+
+	struct jpeg_decompress_struct m_Info;
+	struct jpeg_source_mgr m_Source;
+	JpegError m_Error;
+	bool m_bCreated = false;
+	std::string m_strErrorMsg = "";
+
+	//the page area to look at and the results of the blocks seen so far
+	uint32_t m_iLeft = 0, m_iTop = 0, m_iRight = 0, m_iBottom = 0;
+	int m_iTolerance = 0;
+	uint64_t m_iInk = 0;		//ink pixels there are for sure
+	bool m_bWhite = true;		//every block is within the tolerance of white
+	bool m_bNeutral = true;		//every chroma block decodes to no colour
+	bool m_bColour = false;		//a chroma block has colour for sure
+
+	bool LoadChunk(uint32_t iChunk);
+	bool ReadChunk(uint32_t iChunk);
+	void AnalyzeCoefficients(uint32_t iChunk, jvirt_barray_ptr* pCoefficients);
+
+	//jpeg_source_mgr procs over a block of memory
+	static void InitSource(j_decompress_ptr pInfo);
+	static boolean FillInputBuffer(j_decompress_ptr pInfo);
+	static void SkipInputData(j_decompress_ptr pInfo, long iBytes);
+	static void TermSource(j_decompress_ptr pInfo);
+	static void ErrorExit(j_common_ptr pInfo);
+	static void OutputMessage(j_common_ptr pInfo);
+
+public:
+	CTiffJpegAnalyzer() = default;
+	~CTiffJpegAnalyzer();
+
+	//avoid copying of this objects
+	CTiffJpegAnalyzer(const CTiffJpegAnalyzer& second) = delete;
+
+	//prepares the current page of the file, it has to be JPEG compressed
+	bool Open(TIFF* pFile);
+
+	//YES when every pixel inside of the rectangle is within iTolerance of white,
+	//NO when there are more than iMaxInk ink pixels for sure
+	bool CheckBlank(int iTolerance, uint64_t iMaxInk, uint32_t iLeft, uint32_t iTop, uint32_t iRight, uint32_t iBottom, m_eVerdict& eResult);
+
+	//YES when the chroma of every block is neutral(R == G == B), NO when a block has colour for sure
+	bool CheckGray(m_eVerdict& eResult);
+
+	std::string GetErrorMsg();
+};
@@ -0,0 +1,142 @@
+#include "TiffJpegTranscoder.h"
+
+CTiffJpegTranscoder::~CTiffJpegTranscoder()
+{
+	if (m_bOutputCreated)
+		jpeg_destroy_compress(&m_Output);
+}
+
+bool CTiffJpegTranscoder::Open(TIFF* pFile)
+{
+	uint16 iSamplesPerPixel = 0, iBitsPerSample = 0;
+
+	if (!CTiffJpegAnalyzer::Open(pFile))
+		return false;
+
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_SAMPLESPERPIXEL, &iSamplesPerPixel);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_BITSPERSAMPLE, &iBitsPerSample);
+
+	if (!m_bYCbCr || (iSamplesPerPixel != 3) || (iBitsPerSample != 8))
+	{
+		m_strErrorMsg = "Only 8 bit YCbCr JPEG pages can be transcoded to gray!!";
+		return false;
+	}
+
+	if (!m_bOutputCreated)
+	{
+		//the encoder shares the error handling of the decoder
+		m_Output.err = &m_Error._mgr;
+
+		if (setjmp(m_Error._jmp))
+		{
+			m_strErrorMsg = "Error creating the JPEG encoder!!";
+			return false;
+		}
+
+		jpeg_create_compress(&m_Output);
+		m_bOutputCreated = true;
+
+		m_Destination._mgr.init_destination = InitDestination;
+		m_Destination._mgr.empty_output_buffer = EmptyOutputBuffer;
+		m_Destination._mgr.term_destination = TermDestination;
+		m_Output.dest = &m_Destination._mgr;
+	}
+
+	m_vOutTables.clear();
+	return true;
+}
+
+bool CTiffJpegTranscoder::ToGray(uint32_t iChunk, std::vector<unsigned char>& vOutput)
+{
+	if (!LoadChunk(iChunk))
+		return false;
+
+	if (setjmp(m_Error._jmp))
+	{
+		jpeg_abort_compress(&m_Output);
+		jpeg_abort_decompress(&m_Info);
+		m_strErrorMsg = "Error transcoding chunk " + std::to_string(iChunk) + " to gray!!";
+		return false;
+	}
+
+	m_Source.next_input_byte = m_vChunk.data();
+	m_Source.bytes_in_buffer = m_vChunk.size();
+
+	if ((jpeg_read_header(&m_Info, TRUE) != JPEG_HEADER_OK) || (m_Info.jpeg_color_space != JCS_YCbCr) || (m_Info.num_components != 3))
+	{
+		jpeg_abort_decompress(&m_Info);
+		m_strErrorMsg = "Chunk " + std::to_string(iChunk) + " is no YCbCr JPEG stream!!";
+		return false;
+	}
+
+	jvirt_barray_ptr* pCoefficients = jpeg_read_coefficients(&m_Info);
+
+	//same size and quantization, only component 0 is left. the Y block array of a subsampled
+	//page is padded to its MCUs, which covers the blocks of the 1x1 sampled gray component
+	jpeg_copy_critical_parameters(&m_Info, &m_Output);
+	int iQuantTable = m_Output.comp_info[0].quant_tbl_no;
+	jpeg_set_colorspace(&m_Output, JCS_GRAYSCALE);
+	m_Output.comp_info[0].quant_tbl_no = iQuantTable;
+
+	//TIFF JPEG streams carry no JFIF/Adobe markers
+	m_Output.write_JFIF_header = FALSE;
+	m_Output.write_Adobe_marker = FALSE;
+
+	//the chunks of a page normally share their tables, these go to JPEGTABLES once.
+	//tables left marked as sent by the previous chunk are written again
+	jpeg_suppress_tables(&m_Output, FALSE);
+	m_Destination._pOutput = &m_vChunkTables;
+	jpeg_write_tables(&m_Output);
+
+	if (m_vOutTables.empty())
+		m_vOutTables = m_vChunkTables;
+
+	m_Destination._pOutput = &vOutput;
+	jpeg_write_coefficients(&m_Output, pCoefficients);
+
+	//a chunk with other tables keeps them in its own stream
+	if (m_vChunkTables == m_vOutTables)
+		jpeg_suppress_tables(&m_Output, TRUE);
+
+	jpeg_finish_compress(&m_Output);
+
+	//releases the coefficients but keeps the tables
+	jpeg_abort_decompress(&m_Info);
+	return true;
+}
+
+const std::vector<unsigned char>& CTiffJpegTranscoder::GetTables()
+{
+	return m_vOutTables;
+}
+
+void CTiffJpegTranscoder::InitDestination(j_compress_ptr pInfo)
+{
+	JpegDestination* pDestination = (JpegDestination*)pInfo->dest;
+	std::vector<unsigned char>* pOutput = pDestination->_pOutput;
+
+	if (pOutput->size() < 4096)
+		pOutput->resize(4096);
+
+	pDestination->_mgr.next_output_byte = pOutput->data();
+	pDestination->_mgr.free_in_buffer = pOutput->size();
+}
+
+boolean CTiffJpegTranscoder::EmptyOutputBuffer(j_compress_ptr pInfo)
+{
+	//libjpeg only calls this with a full buffer
+	JpegDestination* pDestination = (JpegDestination*)pInfo->dest;
+	std::vector<unsigned char>* pOutput = pDestination->_pOutput;
+	size_t iUsed = pOutput->size();
+
+	pOutput->resize(iUsed * 2);
+	pDestination->_mgr.next_output_byte = pOutput->data() + iUsed;
+	pDestination->_mgr.free_in_buffer = pOutput->size() - iUsed;
+	return TRUE;
+}
+
+void CTiffJpegTranscoder::TermDestination(j_compress_ptr pInfo)
+{
+	JpegDestination* pDestination = (JpegDestination*)pInfo->dest;
+	pDestination->_pOutput->resize(pDestination->_pOutput->size() - pDestination->_mgr.free_in_buffer);
+}
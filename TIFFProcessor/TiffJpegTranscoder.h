@@ -0,0 +1,43 @@
+#pragma once
+#include "TiffJpegAnalyzer.h"
+
+//turns the strips(or tiles) of YCbCr JPEG pages into 1 component JPEG streams of their luma.
+//the quantized Y coefficients are written as they are read with jpeg_write_coefficients, like jpegtran -grayscale,
+//so the luma is kept bit exact and the chroma is dropped without a decode/encode round trip
+class CTiffJpegTranscoder : public CTiffJpegAnalyzer
+{
+private:
+	//jpeg_destination_mgr over a growing block of memory
+	typedef struct JpegDestination
+	{
+		struct jpeg_destination_mgr _mgr;
+		std::vector<unsigned char>* _pOutput;
+	}JpegDestination;
+
+	struct jpeg_compress_struct m_Output;
+	JpegDestination m_Destination;
+	bool m_bOutputCreated = false;
+
+	std::vector<unsigned char> m_vOutTables;	//tables only stream of the first chunk, the JPEGTABLES of the gray page
+	std::vector<unsigned char> m_vChunkTables;	//tables of the current chunk
+
+	static void InitDestination(j_compress_ptr pInfo);
+	static boolean EmptyOutputBuffer(j_compress_ptr pInfo);
+	static void TermDestination(j_compress_ptr pInfo);
+
+public:
+	CTiffJpegTranscoder() = default;
+	~CTiffJpegTranscoder();
+
+	//avoid copying of this objects
+	CTiffJpegTranscoder(const CTiffJpegTranscoder& second) = delete;
+
+	//prepares the current page of the file, it has to be a 3 component YCbCr JPEG page
+	bool Open(TIFF* pFile);
+
+	//luma of the chunk as a JPEG stream. the stream is abbreviated when its tables are the ones of GetTables()
+	bool ToGray(uint32_t iChunk, std::vector<unsigned char>& vOutput);
+
+	//tables of the gray page, empty before the first chunk
+	const std::vector<unsigned char>& GetTables();
+};
@@ -0,0 +1,195 @@
+#include "TiffMappedFile.h"
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+CTiffMappedFile::~CTiffMappedFile()
+{
+	Unmap();
+}
+
+bool CTiffMappedFile::Map(const std::string& strFile, m_eAccessHint eHint)
+{
+#ifdef _WIN32
+	//windows has no madvise, the access pattern is given to the cache manager when the file is opened
+	DWORD dwFlags = (eHint == RANDOM) ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+
+	m_hFile = CreateFileA(strFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, dwFlags, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER iFileSize;
+	if (!GetFileSizeEx(m_hFile, &iFileSize) || (iFileSize.QuadPart == 0))
+		return false;
+
+	//a 32 bit process cant map files bigger than its address space
+	if ((uint64)iFileSize.QuadPart > (uint64)SIZE_MAX)
+		return false;
+
+	m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping)
+		return false;
+
+	m_pData = (unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_pData)
+		return false;
+
+	m_iSize = (uint64)iFileSize.QuadPart;
+#else
+	m_iFd = open(strFile.c_str(), O_RDONLY);
+	if (m_iFd < 0)
+		return false;
+
+	struct stat fileStat;
+	if ((fstat(m_iFd, &fileStat) != 0) || (fileStat.st_size == 0))
+		return false;
+
+	void* pData = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, m_iFd, 0);
+	if (pData == MAP_FAILED)
+		return false;
+
+	m_pData = (unsigned char*)pData;
+	m_iSize = (uint64)fileStat.st_size;
+	madvise(m_pData, (size_t)m_iSize, (eHint == RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+
+	m_iPos = 0;
+	return true;
+}
+
+void CTiffMappedFile::Unmap()
+{
+#ifdef _WIN32
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hMapping = nullptr;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pData)
+		munmap(m_pData, (size_t)m_iSize);
+	if (m_iFd >= 0)
+		close(m_iFd);
+
+	m_iFd = -1;
+#endif
+
+	m_pData = nullptr;
+	m_iSize = 0;
+	m_iPos = 0;
+}
+
+TIFF* CTiffMappedFile::Open(const std::string& strFile, m_eAccessHint eHint)
+{
+	CTiffMappedFile* pMappedFile = new CTiffMappedFile();
+
+	if (!pMappedFile->Map(strFile, eHint))
+	{
+		delete pMappedFile;
+		return nullptr;
+	}
+
+	//on success the TIFF owns the mapping and deletes it in CloseProc
+	TIFF* pFile = TIFFClientOpen(strFile.c_str(), "r", (thandle_t)pMappedFile,
+								 ReadProc, WriteProc, SeekProc, CloseProc, SizeProc, MapProc, UnmapProc);
+	if (!pFile)
+		delete pMappedFile;
+
+	return pFile;
+}
+
+bool CTiffMappedFile::Advise(TIFF* pFile, m_eAccessHint eHint)
+{
+	if (!pFile || (TIFFGetCloseProc(pFile) != CloseProc))
+		return false;
+
+	CTiffMappedFile* pMappedFile = (CTiffMappedFile*)TIFFClientdata(pFile);
+
+#ifdef _WIN32
+	//the hint can only be set when the file is opened
+	(void)pMappedFile;
+	(void)eHint;
+	return false;
+#else
+	return (madvise(pMappedFile->m_pData, (size_t)pMappedFile->m_iSize, (eHint == RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL) == 0);
+#endif
+}
+
+tmsize_t CTiffMappedFile::ReadProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize)
+{
+	CTiffMappedFile* pMappedFile = (CTiffMappedFile*)pHandle;
+
+	if ((iSize <= 0) || (pMappedFile->m_iPos >= pMappedFile->m_iSize))
+		return 0;
+
+	uint64 iAvailable = pMappedFile->m_iSize - pMappedFile->m_iPos;
+	if ((uint64)iSize > iAvailable)
+		iSize = (tmsize_t)iAvailable;
+
+	memcpy(pBuffer, pMappedFile->m_pData + pMappedFile->m_iPos, (size_t)iSize);
+	pMappedFile->m_iPos += iSize;
+
+	return iSize;
+}
+
+tmsize_t CTiffMappedFile::WriteProc(thandle_t, void*, tmsize_t)
+{
+	//the mapping is read-only
+	return -1;
+}
+
+toff_t CTiffMappedFile::SeekProc(thandle_t pHandle, toff_t iOffset, int iWhence)
+{
+	CTiffMappedFile* pMappedFile = (CTiffMappedFile*)pHandle;
+
+	switch (iWhence)
+	{
+	case SEEK_SET:
+		pMappedFile->m_iPos = iOffset;
+		break;
+	case SEEK_CUR:
+		pMappedFile->m_iPos += iOffset;
+		break;
+	case SEEK_END:
+		pMappedFile->m_iPos = pMappedFile->m_iSize + iOffset;
+		break;
+	default:
+		return (toff_t)-1;
+	}
+
+	return pMappedFile->m_iPos;
+}
+
+int CTiffMappedFile::CloseProc(thandle_t pHandle)
+{
+	delete (CTiffMappedFile*)pHandle;
+	return 0;
+}
+
+toff_t CTiffMappedFile::SizeProc(thandle_t pHandle)
+{
+	return ((CTiffMappedFile*)pHandle)->m_iSize;
+}
+
+int CTiffMappedFile::MapProc(thandle_t pHandle, void** ppBase, toff_t* pSize)
+{
+	CTiffMappedFile* pMappedFile = (CTiffMappedFile*)pHandle;
+
+	*ppBase = pMappedFile->m_pData;
+	*pSize = pMappedFile->m_iSize;
+
+	return 1;
+}
+
+void CTiffMappedFile::UnmapProc(thandle_t, void*, toff_t)
+{
+	//the mapping lives until CloseProc
+}
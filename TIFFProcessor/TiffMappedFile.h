@@ -0,0 +1,53 @@
+#pragma once
+#include "tiffio.h"
+#include <string>
+#include <cstdint>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+//read-only memory mapped input for libtiff.
+//the file is mapped once and handed to TIFFClientOpen, so libtiff reads strips straight out of
+//the page cache instead of copying them through read() calls.
+class CTiffMappedFile
+{
+public:
+	typedef enum AccessHint { SEQUENTIAL = 0, RANDOM } m_eAccessHint;
+
+private:
+	unsigned char* m_pData = nullptr;
+	uint64 m_iSize = 0;
+	uint64 m_iPos = 0;
+#ifdef _WIN32
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE m_hMapping = nullptr;
+#else
+	int m_iFd = -1;
+#endif
+
+	CTiffMappedFile() = default;
+	bool Map(const std::string& strFile, m_eAccessHint eHint);
+	void Unmap();
+
+	//TIFFClientOpen procs, the client data is the CTiffMappedFile itself
+	static tmsize_t ReadProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize);
+	static tmsize_t WriteProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize);
+	static toff_t SeekProc(thandle_t pHandle, toff_t iOffset, int iWhence);
+	static int CloseProc(thandle_t pHandle);
+	static toff_t SizeProc(thandle_t pHandle);
+	static int MapProc(thandle_t pHandle, void** ppBase, toff_t* pSize);
+	static void UnmapProc(thandle_t pHandle, void* pBase, toff_t iSize);
+
+public:
+	~CTiffMappedFile();
+
+	//avoid copying of this objects
+	CTiffMappedFile(const CTiffMappedFile& second) = delete;
+
+	//opens the file read-only through a mapping, returns nullptr if the file cant be mapped.
+	//the mapping is released by TIFFClose.
+	static TIFF* Open(const std::string& strFile, m_eAccessHint eHint = SEQUENTIAL);
+
+	//changes the access pattern hint of a file opened with Open()
+	static bool Advise(TIFF* pFile, m_eAccessHint eHint);
+};
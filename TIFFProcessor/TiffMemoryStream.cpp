@@ -0,0 +1,158 @@
+#include "TiffMemoryStream.h"
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <algorithm>
+
+TIFF* CTiffMemoryStream::OpenRead(const unsigned char* pData, size_t iSize)
+{
+	if (!pData || (iSize == 0))
+		return nullptr;
+
+	CTiffMemoryStream* pStream = new CTiffMemoryStream();
+	pStream->m_pData = pData;
+	pStream->m_iSize = iSize;
+
+	//on success the TIFF owns the stream and deletes it in CloseProc
+	TIFF* pFile = TIFFClientOpen("memory", "r", (thandle_t)pStream,
+								 ReadProc, WriteProc, SeekProc, CloseProc, SizeProc, MapProc, UnmapProc);
+	if (!pFile)
+		delete pStream;
+
+	return pFile;
+}
+
+TIFF* CTiffMemoryStream::OpenWrite(std::vector<unsigned char>& vBuffer, const char* pMode)
+{
+	CTiffMemoryStream* pStream = new CTiffMemoryStream();
+	pStream->m_pBuffer = &vBuffer;
+
+	//"w" starts a new image, "a" appends pages to the image already in the buffer
+	if (pMode[0] == 'w')
+		vBuffer.clear();
+
+	pStream->m_iSize = vBuffer.size();
+
+	//the buffer grows while writing, so it must not be mapped
+	std::string strMode = std::string(pMode) + "m";
+	TIFF* pFile = TIFFClientOpen("memory", strMode.c_str(), (thandle_t)pStream,
+								 ReadProc, WriteProc, SeekProc, CloseProc, SizeProc, MapProc, UnmapProc);
+	if (!pFile)
+		delete pStream;
+
+	return pFile;
+}
+
+bool CTiffMemoryStream::IsMemoryStream(TIFF* pFile)
+{
+	return TIFFGetReadProc(pFile) == ReadProc;
+}
+
+TIFF* CTiffMemoryStream::Reopen(TIFF* pFile)
+{
+	if (!IsMemoryStream(pFile))
+		return nullptr;
+
+	//output buffers move while they grow, they are not shared
+	CTiffMemoryStream* pStream = (CTiffMemoryStream*)TIFFClientdata(pFile);
+	if (!pStream->m_pData)
+		return nullptr;
+
+	return OpenRead(pStream->m_pData, (size_t)pStream->m_iSize);
+}
+
+const unsigned char* CTiffMemoryStream::GetData() const
+{
+	return m_pBuffer ? m_pBuffer->data() : m_pData;
+}
+
+tmsize_t CTiffMemoryStream::ReadProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize)
+{
+	CTiffMemoryStream* pStream = (CTiffMemoryStream*)pHandle;
+
+	if ((iSize <= 0) || (pStream->m_iPos >= pStream->m_iSize))
+		return 0;
+
+	uint64 iAvailable = pStream->m_iSize - pStream->m_iPos;
+	if ((uint64)iSize > iAvailable)
+		iSize = (tmsize_t)iAvailable;
+
+	memcpy(pBuffer, pStream->GetData() + pStream->m_iPos, (size_t)iSize);
+	pStream->m_iPos += iSize;
+
+	return iSize;
+}
+
+tmsize_t CTiffMemoryStream::WriteProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize)
+{
+	CTiffMemoryStream* pStream = (CTiffMemoryStream*)pHandle;
+
+	if (!pStream->m_pBuffer || (iSize < 0))
+		return -1;
+
+	uint64 iEnd = pStream->m_iPos + iSize;
+	if (iEnd > pStream->m_pBuffer->size())
+	{
+		//grow geometrically, libtiff writes a page in many small pieces
+		if (iEnd > pStream->m_pBuffer->capacity())
+			pStream->m_pBuffer->reserve((size_t)std::max<uint64>(iEnd, 2 * pStream->m_pBuffer->capacity()));
+		pStream->m_pBuffer->resize((size_t)iEnd);
+	}
+
+	memcpy(pStream->m_pBuffer->data() + pStream->m_iPos, pBuffer, (size_t)iSize);
+	pStream->m_iPos = iEnd;
+	pStream->m_iSize = pStream->m_pBuffer->size();
+
+	return iSize;
+}
+
+toff_t CTiffMemoryStream::SeekProc(thandle_t pHandle, toff_t iOffset, int iWhence)
+{
+	CTiffMemoryStream* pStream = (CTiffMemoryStream*)pHandle;
+
+	switch (iWhence)
+	{
+	case SEEK_SET:
+		pStream->m_iPos = iOffset;
+		break;
+	case SEEK_CUR:
+		pStream->m_iPos += iOffset;
+		break;
+	case SEEK_END:
+		pStream->m_iPos = pStream->m_iSize + iOffset;
+		break;
+	default:
+		return (toff_t)-1;
+	}
+
+	return pStream->m_iPos;
+}
+
+int CTiffMemoryStream::CloseProc(thandle_t pHandle)
+{
+	delete (CTiffMemoryStream*)pHandle;
+	return 0;
+}
+
+toff_t CTiffMemoryStream::SizeProc(thandle_t pHandle)
+{
+	return ((CTiffMemoryStream*)pHandle)->m_iSize;
+}
+
+int CTiffMemoryStream::MapProc(thandle_t pHandle, void** ppBase, toff_t* pSize)
+{
+	CTiffMemoryStream* pStream = (CTiffMemoryStream*)pHandle;
+
+	//only the read-only input can be handed out, the output buffer may move while growing
+	if (!pStream->m_pData)
+		return 0;
+
+	*ppBase = (void*)pStream->m_pData;
+	*pSize = pStream->m_iSize;
+
+	return 1;
+}
+
+void CTiffMemoryStream::UnmapProc(thandle_t, void*, toff_t)
+{
+}
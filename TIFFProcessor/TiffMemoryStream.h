@@ -0,0 +1,45 @@
+#pragma once
+#include "tiffio.h"
+#include <vector>
+#include <cstdint>
+
+//TIFF files held in memory.
+//libtiff reads and writes the buffer through TIFFClientOpen procs, so no file is ever created on disk.
+class CTiffMemoryStream
+{
+private:
+	const unsigned char* m_pData = nullptr;		//read-only input
+	std::vector<unsigned char>* m_pBuffer = nullptr;	//writable output, owned by the caller
+	uint64 m_iSize = 0;
+	uint64 m_iPos = 0;
+
+	CTiffMemoryStream() = default;
+
+	const unsigned char* GetData() const;
+
+	//TIFFClientOpen procs, the client data is the CTiffMemoryStream itself
+	static tmsize_t ReadProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize);
+	static tmsize_t WriteProc(thandle_t pHandle, void* pBuffer, tmsize_t iSize);
+	static toff_t SeekProc(thandle_t pHandle, toff_t iOffset, int iWhence);
+	static int CloseProc(thandle_t pHandle);
+	static toff_t SizeProc(thandle_t pHandle);
+	static int MapProc(thandle_t pHandle, void** ppBase, toff_t* pSize);
+	static void UnmapProc(thandle_t pHandle, void* pBase, toff_t iSize);
+
+public:
+	//avoid copying of this objects
+	CTiffMemoryStream(const CTiffMemoryStream& second) = delete;
+
+	//opens a TIFF image in memory for reading, the data must stay valid until TIFFClose
+	static TIFF* OpenRead(const unsigned char* pData, size_t iSize);
+
+	//true for files opened by this class
+	static bool IsMemoryStream(TIFF* pFile);
+
+	//a second read handle on the image of a memory stream opened with OpenRead, nullptr for other files
+	static TIFF* Reopen(TIFF* pFile);
+
+	//opens a TIFF image for writing("w", "w8") or appending("a") into the given buffer.
+	//the buffer holds the complete file after TIFFClose.
+	static TIFF* OpenWrite(std::vector<unsigned char>& vBuffer, const char* pMode = "w");
+};
@@ -0,0 +1,146 @@
+#include "TiffOrderedJobs.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+CTiffOrderedJobs::CTiffOrderedJobs(unsigned iThreads, uint32_t iLookahead) : m_iThreads(std::max(1u, iThreads)), m_iLookahead(std::max<uint32_t>(1, iLookahead))
+{
+}
+
+bool CTiffOrderedJobs::Run(uint32_t iJobs, const JobFunction& fnJob, const CommitFunction& fnCommit)
+{
+	return Run(iJobs, ReadFunction(), fnJob, fnCommit);
+}
+
+bool CTiffOrderedJobs::Run(uint32_t iJobs, const ReadFunction& fnRead, const JobFunction& fnJob, const CommitFunction& fnCommit)
+{
+	typedef enum JobState { PENDING = 0, DONE, FAILED } m_eJobState;
+
+	bool bRes = true;
+	std::vector<m_eJobState> vStates(iJobs, PENDING);
+	std::mutex mutex;
+	std::condition_variable jobDone, slotChanged;
+	uint32_t iNextJob = 0, iCommitted = 0;
+	uint32_t iRead = fnRead ? 0 : iJobs;
+	uint32_t iRunnable = iJobs;		//jobs before a failed read
+	bool bStop = false;
+
+	m_iFailedJob = UINT32_MAX;
+
+	//the reads are done in job order on one thread, the input is read front to back while the workers decode
+	auto reader = [&]()
+	{
+		for (uint32_t iJob = 0; iJob < iJobs; iJob++)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotChanged.wait(lock, [&]() { return bStop || (iJob < iCommitted + m_iLookahead); });
+				if (bStop)
+					break;
+			}
+
+			bool bReadRes = fnRead(iJob);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				//the jobs read before the failed one may not be taken yet, they are still done
+				if (bReadRes)
+					iRead = iJob + 1;
+				else
+				{
+					vStates[iJob] = FAILED;
+					iRunnable = iJob;
+				}
+			}
+
+			jobDone.notify_all();
+			slotChanged.notify_all();
+
+			if (!bReadRes)
+				break;
+		}
+	};
+
+	//the jobs are taken in order, so every job before a failed one is taken and will be done
+	auto worker = [&](unsigned iWorker)
+	{
+		while (true)
+		{
+			uint32_t iJob = 0;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotChanged.wait(lock, [&]() { return bStop || (iNextJob >= iRunnable) || ((iNextJob < iCommitted + m_iLookahead) && (iNextJob < iRead)); });
+				if (bStop || (iNextJob >= iRunnable))
+					break;
+
+				iJob = iNextJob++;
+			}
+
+			bool bJobRes = fnJob(iWorker, iJob);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				vStates[iJob] = bJobRes ? DONE : FAILED;
+				if (!bJobRes)
+					bStop = true;
+			}
+
+			jobDone.notify_all();
+			slotChanged.notify_all();
+		}
+	};
+
+	std::vector<std::thread> vThreads;
+	if (fnRead && (iJobs > 0))
+		vThreads.emplace_back(reader);
+
+	for (unsigned i = 0; i < std::min<uint32_t>(m_iThreads, iJobs); i++)
+		vThreads.emplace_back(worker, i);
+
+	for (uint32_t iJob = 0; iJob < iJobs; iJob++)
+	{
+		m_eJobState state = PENDING;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobDone.wait(lock, [&]() { return vStates[iJob] != PENDING; });
+			state = vStates[iJob];
+		}
+
+		if (state == FAILED)
+		{
+			m_iFailedJob = iJob;
+			bRes = false;
+			break;
+		}
+
+		if (!fnCommit(iJob))
+		{
+			bRes = false;
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			iCommitted = iJob + 1;
+		}
+
+		slotChanged.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bStop = true;
+	}
+
+	slotChanged.notify_all();
+
+	for (std::thread& thread : vThreads)
+		thread.join();
+
+	return bRes;
+}
+
+uint32_t CTiffOrderedJobs::GetFailedJob() const
+{
+	return m_iFailedJob;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <functional>
+#include <cstdint>
+
+//runs numbered jobs as a pipeline of three stages: an optional read stage on a thread of its own in job order,
+//the jobs on worker threads, and the handover in job order on the calling thread.
+//at most the lookahead of jobs are between the read and the handover, so job data can be kept in
+//lookahead slots that are used again(job % lookahead) and the memory stays the same for any number of jobs
+class CTiffOrderedJobs
+{
+public:
+	//a job runs on worker iWorker(0 to threads - 1), state kept per worker can be indexed by it
+	typedef std::function<bool(unsigned iWorker, uint32_t iJob)> JobFunction;
+	typedef std::function<bool(uint32_t iJob)> ReadFunction;
+	typedef std::function<bool(uint32_t iJob)> CommitFunction;
+
+private:
+	unsigned m_iThreads = 1;
+	uint32_t m_iLookahead = 1;
+	uint32_t m_iFailedJob = UINT32_MAX;
+
+public:
+	CTiffOrderedJobs(unsigned iThreads, uint32_t iLookahead);
+	~CTiffOrderedJobs() = default;
+
+	//avoid copying of this objects
+	CTiffOrderedJobs(const CTiffOrderedJobs& second) = delete;
+
+	//false once a job or a commit fails, the jobs after it are not committed
+	bool Run(uint32_t iJobs, const JobFunction& fnJob, const CommitFunction& fnCommit);
+
+	//the same with a read stage, a job starts once it is read. the slot of a job is free for the read once the
+	//job a lookahead before it is committed
+	bool Run(uint32_t iJobs, const ReadFunction& fnRead, const JobFunction& fnJob, const CommitFunction& fnCommit);
+
+	//the job whose read or run failed, UINT32_MAX if it was a commit
+	uint32_t GetFailedJob() const;
+};
@@ -0,0 +1,78 @@
+#include "TiffPageIndex.h"
+
+CTiffPageIndex::CTiffPageIndex(TIFF* pFile)
+{
+	Build(pFile);
+}
+
+bool CTiffPageIndex::Build(TIFF* pFile)
+{
+	Clear();
+
+	if (!pFile)
+		return false;
+
+	m_pFile = pFile;
+
+	//start from the first page in case the file was already positioned somewhere else
+	if ((TIFFCurrentDirectory(pFile) != 0) && !TIFFSetDirectory(pFile, 0))
+		return false;
+
+	do
+	{
+		m_vOffsets.push_back(TIFFCurrentDirOffset(pFile));
+	} while (TIFFReadDirectory(pFile));
+
+	//rewinding after the walk is no random access
+	m_iPage = 0;
+	return SetPage(0);
+}
+
+void CTiffPageIndex::Clear()
+{
+	m_pFile = nullptr;
+	m_vOffsets.clear();
+	m_iPage = 0;
+	m_bRandom = false;
+}
+
+TIFF* CTiffPageIndex::GetFile()
+{
+	return m_pFile;
+}
+
+uint32_t CTiffPageIndex::GetPageCount() const
+{
+	return (uint32_t)m_vOffsets.size();
+}
+
+uint64 CTiffPageIndex::GetPageOffset(uint32_t pageno) const
+{
+	return (pageno < m_vOffsets.size()) ? m_vOffsets[pageno] : 0;
+}
+
+bool CTiffPageIndex::SetPage(uint32_t pageno)
+{
+	if (!m_pFile || (pageno >= m_vOffsets.size()))
+		return false;
+
+	if (!m_bRandom && (pageno != m_iPage) && (pageno != m_iPage + 1))
+	{
+		//read ahead only helps while the pages are read in order
+		CTiffMappedFile::Advise(m_pFile, CTiffMappedFile::RANDOM);
+		m_bRandom = true;
+	}
+
+	//already on the requested page, nothing to read
+	if (TIFFCurrentDirOffset(m_pFile) == m_vOffsets[pageno])
+	{
+		m_iPage = pageno;
+		return true;
+	}
+
+	if (!TIFFSetSubDirectory(m_pFile, m_vOffsets[pageno]))
+		return false;
+
+	m_iPage = pageno;
+	return true;
+}
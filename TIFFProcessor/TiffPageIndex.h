@@ -0,0 +1,32 @@
+#pragma once
+#include "TiffMappedFile.h"
+#include <vector>
+#include <cstdint>
+
+//random access to the pages of a multipage TIFF file.
+//the IFD offset of every page is recorded once, after that any page is loaded directly
+//with TIFFSetSubDirectory instead of walking the IFD chain from the first page again.
+class CTiffPageIndex
+{
+private:
+	TIFF* m_pFile = nullptr;
+	std::vector<uint64> m_vOffsets;
+	uint32_t m_iPage = 0;
+	bool m_bRandom = false;	//the mapping was switched to random access
+
+public:
+	CTiffPageIndex() = default;
+	CTiffPageIndex(TIFF* pFile);
+
+	//walks the IFD chain once, the file is left on the first page
+	bool Build(TIFF* pFile);
+	void Clear();
+
+	TIFF* GetFile();
+	uint32_t GetPageCount() const;
+	uint64 GetPageOffset(uint32_t pageno) const;
+
+	//makes the given page(zero based) the current directory of the file.
+	//the first jump to a page other than the next one switches a mapped file to random access
+	bool SetPage(uint32_t pageno);
+};
@@ -0,0 +1,879 @@
+#include "TiffPixelKernels.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TIFF_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//gcc and clang only emit the instructions of a SIMD level inside of functions built for it,
+//flatten pulls the templated kernel into them. MSVC needs nothing for this.
+#if defined(__GNUC__)
+#define TIFF_TARGET(x) __attribute__((target(x), flatten))
+#else
+#define TIFF_TARGET(x)
+#endif
+
+static const int GRAY_WEIGHT_R = 9794;
+static const int GRAY_WEIGHT_G = 19235;
+static const int GRAY_WEIGHT_B = 3736;
+static const int GRAY_ROUNDING = 16384;
+
+void CTiffPixelKernels::ToGrayScalar(unsigned char* pPixels, size_t iPixels, int iSamplesPerPixel, bool bToBinary, int iThreshold)
+{
+	if (iSamplesPerPixel < 3)
+		return;
+
+	for (size_t i = 0; i < iPixels; i++, pPixels += iSamplesPerPixel)
+	{
+		int iGray = (GRAY_WEIGHT_R * pPixels[0] + GRAY_WEIGHT_G * pPixels[1] + GRAY_WEIGHT_B * pPixels[2] + GRAY_ROUNDING) >> 15;
+
+		if (bToBinary)
+			iGray = (iGray > iThreshold) ? 0xFF : 0;
+
+		pPixels[0] = (unsigned char)iGray;
+		pPixels[1] = (unsigned char)iGray;
+		pPixels[2] = (unsigned char)iGray;
+	}
+}
+
+void CTiffPixelKernels::ToGrayPackedScalar(const unsigned char* pPixels, unsigned char* pGray, size_t iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	if (iSamplesPerPixel < 3)
+		return;
+
+	for (size_t i = 0; i < iPixels; i++, pPixels += iSamplesPerPixel, pGray += iGraySamples)
+	{
+		int iGray = (GRAY_WEIGHT_R * pPixels[0] + GRAY_WEIGHT_G * pPixels[1] + GRAY_WEIGHT_B * pPixels[2] + GRAY_ROUNDING) >> 15;
+
+		if (bToBinary)
+			iGray = (iGray > iThreshold) ? 0xFF : 0;
+
+		//alpha is read before the gray is stored, in place the two may share a byte
+		unsigned char iAlpha = pPixels[3 % iSamplesPerPixel];
+		pGray[0] = (unsigned char)iGray;
+		if (iGraySamples == 2)
+			pGray[1] = iAlpha;
+	}
+}
+
+bool CTiffPixelKernels::IsBlankScalar(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iSamplesPerPixel)
+{
+	bool bAlpha = (iSamplesPerPixel == 2) || (iSamplesPerPixel == 4);
+
+	for (size_t i = 0; i < iBytes; i++)
+	{
+		if ((pData[i] != iWhite) && !(bAlpha && ((i % iSamplesPerPixel) == (size_t)(iSamplesPerPixel - 1))))
+			return false;
+	}
+
+	return true;
+}
+
+uint64_t CTiffPixelKernels::CountInkScalar(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel)
+{
+	bool bAlpha = (iSamplesPerPixel == 2) || (iSamplesPerPixel == 4);
+	uint64_t iInk = 0;
+
+	for (size_t i = 0; i < iBytes; i++)
+	{
+		if (((pData[i] ^ iWhite) > iTolerance) && !(bAlpha && ((i % iSamplesPerPixel) == (size_t)(iSamplesPerPixel - 1))))
+			iInk++;
+	}
+
+	return iInk;
+}
+
+uint64_t CTiffPixelKernels::CountInkBits(const unsigned char* pData, size_t iBytes, unsigned char iWhite)
+{
+	uint64_t iWhiteWord = (iWhite != 0) ? UINT64_MAX : 0;
+	uint64_t iInk = 0;
+
+	//8 bytes at a time, the bitset count is a popcnt where the cpu has one
+	for (; iBytes >= 8; pData += 8, iBytes -= 8)
+	{
+		uint64_t iWord;
+		memcpy(&iWord, pData, 8);
+		iInk += std::bitset<64>(iWord ^ iWhiteWord).count();
+	}
+
+	for (size_t i = 0; i < iBytes; i++)
+		iInk += std::bitset<8>(pData[i] ^ iWhite).count();
+
+	return iInk;
+}
+
+void CTiffPixelKernels::PackBitsScalar(const unsigned char* pGray, unsigned char* pBits, size_t iPixels, int iThreshold)
+{
+	for (size_t i = 0; i < iPixels; i += 8)
+	{
+		unsigned char iByte = 0;
+		size_t iCount = std::min((size_t)8, iPixels - i);
+
+		for (size_t b = 0; b < iCount; b++)
+		{
+			if (pGray[i + b] <= iThreshold)
+				iByte |= (unsigned char)(0x80 >> b);
+		}
+
+		pBits[i / 8] = iByte;
+	}
+}
+
+void CTiffPixelKernels::AddToHistogram(const unsigned char* pData, size_t iBytes, uint64_t* pHistogram)
+{
+	//4 sets of counters, runs of the same byte value would otherwise wait on the previous increment
+	uint32_t counts[4][256] = { { 0 } };
+	size_t i = 0;
+
+	while (i < iBytes)
+	{
+		//32 bit counters are summed up before they can overflow
+		size_t iEnd = std::min(iBytes, i + ((size_t)1 << 30));
+
+		for (; i + 4 <= iEnd; i += 4)
+		{
+			counts[0][pData[i]]++;
+			counts[1][pData[i + 1]]++;
+			counts[2][pData[i + 2]]++;
+			counts[3][pData[i + 3]]++;
+		}
+
+		for (; i < iEnd; i++)
+			counts[0][pData[i]]++;
+
+		for (int v = 0; v < 256; v++)
+		{
+			pHistogram[v] += (uint64_t)counts[0][v] + counts[1][v] + counts[2][v] + counts[3][v];
+			counts[0][v] = counts[1][v] = counts[2][v] = counts[3][v] = 0;
+		}
+	}
+}
+
+int CTiffPixelKernels::GetOtsuThreshold(const uint64_t* pHistogram)
+{
+	double dTotal = 0, dSum = 0;
+	for (int v = 0; v < 256; v++)
+	{
+		dTotal += (double)pHistogram[v];
+		dSum += (double)v * pHistogram[v];
+	}
+
+	//the threshold with the largest variance between the two classes, 
+	//w0 * w1 * (m0 - m1)^2 with the weights and means of dark and light
+	double dDark = 0, dDarkSum = 0, dBest = -1;
+	int iThreshold = 0;
+
+	for (int t = 0; t < 255; t++)
+	{
+		dDark += (double)pHistogram[t];
+		dDarkSum += (double)t * pHistogram[t];
+
+		double dLight = dTotal - dDark;
+		if ((dDark == 0) || (dLight == 0))
+			continue;
+
+		double dDiff = dDarkSum / dDark - (dSum - dDarkSum) / dLight;
+		double dBetween = dDark * dLight * dDiff * dDiff;
+
+		if (dBetween > dBest)
+		{
+			dBest = dBetween;
+			iThreshold = t;
+		}
+	}
+
+	return iThreshold;
+}
+
+#ifdef TIFF_SIMD_X86
+
+//the ink counters are bytes that grow by at most 4 per round of 64 bytes, they are summed up before they can overflow
+static const size_t INK_ROUNDS = 63;
+
+//16 bytes with 0xFF at the bytes to look at, alpha bytes are 0
+static void GetInkMask(unsigned char* pMask, int iSamplesPerPixel)
+{
+	bool bAlpha = (iSamplesPerPixel == 2) || (iSamplesPerPixel == 4);
+
+	for (int b = 0; b < 16; b++)
+		pMask[b] = (bAlpha && ((b % iSamplesPerPixel) == (iSamplesPerPixel - 1))) ? 0x00 : 0xFF;
+}
+
+//the blank checks look at 64 bytes per round and stop at the first round with ink.
+//pData and iBytes are advanced to the bytes left over, the return value is false once ink is found
+static TIFF_TARGET("sse2") bool BlankBlocksSSE2(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iSamplesPerPixel)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m128i vWhite = _mm_set1_epi8((char)iWhite);
+	const __m128i vMask = _mm_load_si128((const __m128i*)mask);
+	const __m128i vZero = _mm_setzero_si128();
+
+	for (; iBytes >= 64; pData += 64, iBytes -= 64)
+	{
+		__m128i vInk = _mm_xor_si128(_mm_loadu_si128((const __m128i*)pData), vWhite);
+		vInk = _mm_or_si128(vInk, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pData + 16)), vWhite));
+		vInk = _mm_or_si128(vInk, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pData + 32)), vWhite));
+		vInk = _mm_or_si128(vInk, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pData + 48)), vWhite));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(vInk, vMask), vZero)) != 0xFFFF)
+			return false;
+	}
+
+	return true;
+}
+
+static TIFF_TARGET("avx2") bool BlankBlocksAVX2(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iSamplesPerPixel)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m256i vWhite = _mm256_set1_epi8((char)iWhite);
+	const __m256i vMask = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)mask));
+
+	for (; iBytes >= 64; pData += 64, iBytes -= 64)
+	{
+		__m256i vInk = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)pData), vWhite);
+		vInk = _mm256_or_si256(vInk, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pData + 32)), vWhite));
+
+		if (!_mm256_testz_si256(vInk, vMask))
+			return false;
+	}
+
+	return true;
+}
+
+static TIFF_TARGET("avx512f,avx512bw") bool BlankBlocksAVX512(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iSamplesPerPixel)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m512i vWhite = _mm512_set1_epi8((char)iWhite);
+	const __m512i vMask = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)mask));
+
+	for (; iBytes >= 64; pData += 64, iBytes -= 64)
+	{
+		__m512i vInk = _mm512_xor_si512(_mm512_loadu_si512((const void*)pData), vWhite);
+
+		if (_mm512_test_epi8_mask(vInk, vMask) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+//the ink counts run in rounds of 64 bytes like the blank checks, the distance of a byte from white
+//is byte ^ iWhite(white is 0x00 or 0xFF) and it is ink when the saturated distance - iTolerance is not 0
+static TIFF_TARGET("sse2") uint64_t InkBlocksSSE2(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel, uint64_t iStopAfter)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m128i vWhite = _mm_set1_epi8((char)iWhite);
+	const __m128i vTolerance = _mm_set1_epi8((char)iTolerance);
+	const __m128i vMask = _mm_load_si128((const __m128i*)mask);
+	const __m128i vZero = _mm_setzero_si128();
+	uint64_t iInk = 0;
+
+	while ((iBytes >= 64) && (iInk <= iStopAfter))
+	{
+		size_t iRounds = std::min(iBytes / 64, INK_ROUNDS);
+		__m128i vCount = vZero;
+
+		for (size_t r = 0; r < iRounds; r++, pData += 64)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				__m128i vDistance = _mm_subs_epu8(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(pData + 16 * k)), vWhite), vTolerance);
+				vCount = _mm_sub_epi8(vCount, _mm_andnot_si128(_mm_cmpeq_epi8(vDistance, vZero), vMask));
+			}
+		}
+
+		__m128i vSum = _mm_sad_epu8(vCount, vZero);
+		iInk += (uint32_t)_mm_cvtsi128_si32(vSum) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(vSum, 8));
+		iBytes -= iRounds * 64;
+	}
+
+	return iInk;
+}
+
+static TIFF_TARGET("avx2") uint64_t InkBlocksAVX2(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel, uint64_t iStopAfter)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m256i vWhite = _mm256_set1_epi8((char)iWhite);
+	const __m256i vTolerance = _mm256_set1_epi8((char)iTolerance);
+	const __m256i vMask = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)mask));
+	const __m256i vZero = _mm256_setzero_si256();
+	uint64_t iInk = 0;
+
+	while ((iBytes >= 64) && (iInk <= iStopAfter))
+	{
+		size_t iRounds = std::min(iBytes / 64, INK_ROUNDS);
+		__m256i vCount = vZero;
+
+		for (size_t r = 0; r < iRounds; r++, pData += 64)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				__m256i vDistance = _mm256_subs_epu8(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pData + 32 * k)), vWhite), vTolerance);
+				vCount = _mm256_sub_epi8(vCount, _mm256_andnot_si256(_mm256_cmpeq_epi8(vDistance, vZero), vMask));
+			}
+		}
+
+		__m256i vSum = _mm256_sad_epu8(vCount, vZero);
+		__m128i vHalf = _mm_add_epi32(_mm256_castsi256_si128(vSum), _mm256_extracti128_si256(vSum, 1));
+		iInk += (uint32_t)_mm_cvtsi128_si32(vHalf) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(vHalf, 8));
+		iBytes -= iRounds * 64;
+	}
+
+	return iInk;
+}
+
+static TIFF_TARGET("avx512f,avx512bw") uint64_t InkBlocksAVX512(const unsigned char*& pData, size_t& iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel, uint64_t iStopAfter)
+{
+	alignas(16) unsigned char mask[16];
+	GetInkMask(mask, iSamplesPerPixel);
+
+	const __m512i vWhite = _mm512_set1_epi8((char)iWhite);
+	const __m512i vTolerance = _mm512_set1_epi8((char)iTolerance);
+	const __m512i vMask = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)mask));
+	const __m512i vZero = _mm512_setzero_si512();
+	uint64_t iInk = 0;
+
+	while ((iBytes >= 64) && (iInk <= iStopAfter))
+	{
+		size_t iRounds = std::min(iBytes / 64, INK_ROUNDS);
+		__m512i vCount = vZero;
+
+		for (size_t r = 0; r < iRounds; r++, pData += 64)
+		{
+			__m512i vDistance = _mm512_subs_epu8(_mm512_xor_si512(_mm512_loadu_si512((const void*)pData), vWhite), vTolerance);
+			vCount = _mm512_sub_epi8(vCount, _mm512_maskz_mov_epi8(_mm512_test_epi8_mask(vDistance, vMask), _mm512_set1_epi8(-1)));
+		}
+
+		iInk += (uint64_t)_mm512_reduce_add_epi64(_mm512_sad_epu8(vCount, vZero));
+		iBytes -= iRounds * 64;
+	}
+
+	return iInk;
+}
+
+//the bit packers compare 16*LANES gray bytes against the threshold and collect the results with movemask.
+//movemask puts the first byte into the low bit, each group of 8 bytes is reversed first so that
+//the first pixel ends up in the high bit of its byte. pGray, pBits and iPixels are advanced to the pixels left over
+alignas(16) static const unsigned char BIT_ORDER[16] = { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+static TIFF_TARGET("ssse3") void BitBlocksSSSE3(const unsigned char*& pGray, unsigned char*& pBits, size_t& iPixels, int iThreshold)
+{
+	const __m128i vThreshold = _mm_set1_epi8((char)iThreshold);
+	const __m128i vOrder = _mm_load_si128((const __m128i*)BIT_ORDER);
+
+	for (; iPixels >= 16; pGray += 16, pBits += 2, iPixels -= 16)
+	{
+		__m128i vGray = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pGray), vOrder);
+		uint16_t iMask = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(vGray, vThreshold), vGray));
+		memcpy(pBits, &iMask, 2);
+	}
+}
+
+static TIFF_TARGET("avx2") void BitBlocksAVX2(const unsigned char*& pGray, unsigned char*& pBits, size_t& iPixels, int iThreshold)
+{
+	const __m256i vThreshold = _mm256_set1_epi8((char)iThreshold);
+	const __m256i vOrder = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)BIT_ORDER));
+
+	for (; iPixels >= 32; pGray += 32, pBits += 4, iPixels -= 32)
+	{
+		__m256i vGray = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)pGray), vOrder);
+		uint32_t iMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(vGray, vThreshold), vGray));
+		memcpy(pBits, &iMask, 4);
+	}
+}
+
+static TIFF_TARGET("avx512f,avx512bw") void BitBlocksAVX512(const unsigned char*& pGray, unsigned char*& pBits, size_t& iPixels, int iThreshold)
+{
+	const __m512i vThreshold = _mm512_set1_epi8((char)iThreshold);
+	const __m512i vOrder = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)BIT_ORDER));
+
+	for (; iPixels >= 64; pGray += 64, pBits += 8, iPixels -= 64)
+	{
+		__m512i vGray = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)pGray), vOrder);
+		uint64_t iMask = (uint64_t)_mm512_cmple_epu8_mask(vGray, vThreshold);
+		memcpy(pBits, &iMask, 8);
+	}
+}
+
+//byte shuffles of a 16 byte lane. 16 pixels take iSamplesPerPixel lanes, pick[k][c] gathers channel c
+//of the pixels found in lane k(c 3 is alpha), spread[k] puts the 16 gray values back in place of R, G and B of lane k
+//and alpha[k] keeps the alpha bytes of lane k
+typedef struct ShuffleMasks
+{
+	alignas(16) unsigned char pick[4][4][16];
+	alignas(16) unsigned char spread[4][16];
+	alignas(16) unsigned char alpha[4][16];
+
+	ShuffleMasks(int iSamplesPerPixel)
+	{
+		for (int k = 0; k < iSamplesPerPixel; k++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				for (int j = 0; j < 16; j++)
+				{
+					int iByte = j * iSamplesPerPixel + c - 16 * k;
+					pick[k][c][j] = ((iByte >= 0) && (iByte < 16)) ? (unsigned char)iByte : 0x80;
+				}
+			}
+
+			for (int b = 0; b < 16; b++)
+			{
+				int iByte = 16 * k + b;
+				bool bAlpha = ((iByte % iSamplesPerPixel) == 3);
+				spread[k][b] = bAlpha ? 0x80 : (unsigned char)((iByte / iSamplesPerPixel) & 0x0F);
+				alpha[k][b] = bAlpha ? 0xFF : 0x00;
+			}
+		}
+	}
+}ShuffleMasks;
+
+static const ShuffleMasks& GetShuffleMasks(int iSamplesPerPixel)
+{
+	static const ShuffleMasks masks3(3), masks4(4);
+	return (iSamplesPerPixel == 4) ? masks4 : masks3;
+}
+
+//the same kernel runs on 1, 2 or 4 lanes of 16 pixels. the shuffles work inside of 128 bit lanes,
+//so lane l of every register holds the pixels 16*l to 16*l+15 of a block
+typedef struct SSSE3Ops
+{
+	typedef __m128i V;
+	static const int LANES = 1;
+
+	static TIFF_TARGET("ssse3") V Load(const unsigned char* p, int, int k) { return _mm_loadu_si128((const __m128i*)(p + 16 * k)); }
+	static TIFF_TARGET("ssse3") void Store(unsigned char* p, int, int k, V v) { _mm_storeu_si128((__m128i*)(p + 16 * k), v); }
+	static TIFF_TARGET("ssse3") V Mask(const unsigned char* m) { return _mm_load_si128((const __m128i*)m); }
+	static TIFF_TARGET("ssse3") V Shuffle(V a, V m) { return _mm_shuffle_epi8(a, m); }
+	static TIFF_TARGET("ssse3") V Or(V a, V b) { return _mm_or_si128(a, b); }
+	static TIFF_TARGET("ssse3") V And(V a, V b) { return _mm_and_si128(a, b); }
+	static TIFF_TARGET("ssse3") V Zero() { return _mm_setzero_si128(); }
+	static TIFF_TARGET("ssse3") V Set8(char x) { return _mm_set1_epi8(x); }
+	static TIFF_TARGET("ssse3") V Set32(int x) { return _mm_set1_epi32(x); }
+	static TIFF_TARGET("ssse3") V UnpackLo8(V a, V b) { return _mm_unpacklo_epi8(a, b); }
+	static TIFF_TARGET("ssse3") V UnpackHi8(V a, V b) { return _mm_unpackhi_epi8(a, b); }
+	static TIFF_TARGET("ssse3") V UnpackLo16(V a, V b) { return _mm_unpacklo_epi16(a, b); }
+	static TIFF_TARGET("ssse3") V UnpackHi16(V a, V b) { return _mm_unpackhi_epi16(a, b); }
+	static TIFF_TARGET("ssse3") V Madd16(V a, V b) { return _mm_madd_epi16(a, b); }
+	static TIFF_TARGET("ssse3") V Add32(V a, V b) { return _mm_add_epi32(a, b); }
+	static TIFF_TARGET("ssse3") V Shr15(V a) { return _mm_srli_epi32(a, 15); }
+	static TIFF_TARGET("ssse3") V Packs32(V a, V b) { return _mm_packs_epi32(a, b); }
+	static TIFF_TARGET("ssse3") V Packus16(V a, V b) { return _mm_packus_epi16(a, b); }
+	static TIFF_TARGET("ssse3") V SubsU8(V a, V b) { return _mm_subs_epu8(a, b); }
+	static TIFF_TARGET("ssse3") V MinU8(V a, V b) { return _mm_min_epu8(a, b); }
+	static TIFF_TARGET("ssse3") V Sub8(V a, V b) { return _mm_sub_epi8(a, b); }
+}SSSE3Ops;
+
+typedef struct AVX2Ops
+{
+	typedef __m256i V;
+	static const int LANES = 2;
+
+	static TIFF_TARGET("avx2") V Load(const unsigned char* p, int spp, int k)
+	{
+		__m128i lo = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(p + 16 * spp + 16 * k));
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+	}
+	static TIFF_TARGET("avx2") void Store(unsigned char* p, int spp, int k, V v)
+	{
+		_mm_storeu_si128((__m128i*)(p + 16 * k), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i*)(p + 16 * spp + 16 * k), _mm256_extracti128_si256(v, 1));
+	}
+	static TIFF_TARGET("avx2") V Mask(const unsigned char* m) { return _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)m)); }
+	static TIFF_TARGET("avx2") V Shuffle(V a, V m) { return _mm256_shuffle_epi8(a, m); }
+	static TIFF_TARGET("avx2") V Or(V a, V b) { return _mm256_or_si256(a, b); }
+	static TIFF_TARGET("avx2") V And(V a, V b) { return _mm256_and_si256(a, b); }
+	static TIFF_TARGET("avx2") V Zero() { return _mm256_setzero_si256(); }
+	static TIFF_TARGET("avx2") V Set8(char x) { return _mm256_set1_epi8(x); }
+	static TIFF_TARGET("avx2") V Set32(int x) { return _mm256_set1_epi32(x); }
+	static TIFF_TARGET("avx2") V UnpackLo8(V a, V b) { return _mm256_unpacklo_epi8(a, b); }
+	static TIFF_TARGET("avx2") V UnpackHi8(V a, V b) { return _mm256_unpackhi_epi8(a, b); }
+	static TIFF_TARGET("avx2") V UnpackLo16(V a, V b) { return _mm256_unpacklo_epi16(a, b); }
+	static TIFF_TARGET("avx2") V UnpackHi16(V a, V b) { return _mm256_unpackhi_epi16(a, b); }
+	static TIFF_TARGET("avx2") V Madd16(V a, V b) { return _mm256_madd_epi16(a, b); }
+	static TIFF_TARGET("avx2") V Add32(V a, V b) { return _mm256_add_epi32(a, b); }
+	static TIFF_TARGET("avx2") V Shr15(V a) { return _mm256_srli_epi32(a, 15); }
+	static TIFF_TARGET("avx2") V Packs32(V a, V b) { return _mm256_packs_epi32(a, b); }
+	static TIFF_TARGET("avx2") V Packus16(V a, V b) { return _mm256_packus_epi16(a, b); }
+	static TIFF_TARGET("avx2") V SubsU8(V a, V b) { return _mm256_subs_epu8(a, b); }
+	static TIFF_TARGET("avx2") V MinU8(V a, V b) { return _mm256_min_epu8(a, b); }
+	static TIFF_TARGET("avx2") V Sub8(V a, V b) { return _mm256_sub_epi8(a, b); }
+}AVX2Ops;
+
+typedef struct AVX512Ops
+{
+	typedef __m512i V;
+	static const int LANES = 4;
+
+	static TIFF_TARGET("avx512f,avx512bw") V Load(const unsigned char* p, int spp, int k)
+	{
+		V v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(p + 16 * k)));
+		v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + 16 * spp + 16 * k)), 1);
+		v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + 32 * spp + 16 * k)), 2);
+		return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + 48 * spp + 16 * k)), 3);
+	}
+	static TIFF_TARGET("avx512f,avx512bw") void Store(unsigned char* p, int spp, int k, V v)
+	{
+		_mm_storeu_si128((__m128i*)(p + 16 * k), _mm512_castsi512_si128(v));
+		_mm_storeu_si128((__m128i*)(p + 16 * spp + 16 * k), _mm512_extracti32x4_epi32(v, 1));
+		_mm_storeu_si128((__m128i*)(p + 32 * spp + 16 * k), _mm512_extracti32x4_epi32(v, 2));
+		_mm_storeu_si128((__m128i*)(p + 48 * spp + 16 * k), _mm512_extracti32x4_epi32(v, 3));
+	}
+	static TIFF_TARGET("avx512f,avx512bw") V Mask(const unsigned char* m) { return _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)m)); }
+	static TIFF_TARGET("avx512f,avx512bw") V Shuffle(V a, V m) { return _mm512_shuffle_epi8(a, m); }
+	static TIFF_TARGET("avx512f,avx512bw") V Or(V a, V b) { return _mm512_or_si512(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V And(V a, V b) { return _mm512_and_si512(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Zero() { return _mm512_setzero_si512(); }
+	static TIFF_TARGET("avx512f,avx512bw") V Set8(char x) { return _mm512_set1_epi8(x); }
+	static TIFF_TARGET("avx512f,avx512bw") V Set32(int x) { return _mm512_set1_epi32(x); }
+	static TIFF_TARGET("avx512f,avx512bw") V UnpackLo8(V a, V b) { return _mm512_unpacklo_epi8(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V UnpackHi8(V a, V b) { return _mm512_unpackhi_epi8(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V UnpackLo16(V a, V b) { return _mm512_unpacklo_epi16(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V UnpackHi16(V a, V b) { return _mm512_unpackhi_epi16(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Madd16(V a, V b) { return _mm512_madd_epi16(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Add32(V a, V b) { return _mm512_add_epi32(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Shr15(V a) { return _mm512_srli_epi32(a, 15); }
+	static TIFF_TARGET("avx512f,avx512bw") V Packs32(V a, V b) { return _mm512_packs_epi32(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Packus16(V a, V b) { return _mm512_packus_epi16(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V SubsU8(V a, V b) { return _mm512_subs_epu8(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V MinU8(V a, V b) { return _mm512_min_epu8(a, b); }
+	static TIFF_TARGET("avx512f,avx512bw") V Sub8(V a, V b) { return _mm512_sub_epi8(a, b); }
+}AVX512Ops;
+
+//converts whole blocks of 16*LANES pixels into pGray, pPixels, pGray and iPixels are advanced to the remaining pixels.
+//iGraySamples equal to iSamplesPerPixel spreads the gray over R, G and B, 1 packs the gray and 2 packs gray and alpha
+template <class T>
+static inline void GrayBlocks(const unsigned char*& pPixels, unsigned char*& pGray, size_t& iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	typedef typename T::V V;
+
+	const ShuffleMasks& masks = GetShuffleMasks(iSamplesPerPixel);
+	const size_t iBlock = 16 * T::LANES;
+	const bool bSpread = (iGraySamples == iSamplesPerPixel);
+
+	V vPick[4][4], vSpread[4], vAlpha[4];
+	for (int k = 0; k < iSamplesPerPixel; k++)
+	{
+		for (int c = 0; c < 4; c++)
+			vPick[k][c] = T::Mask(masks.pick[k][c]);
+		vSpread[k] = T::Mask(masks.spread[k]);
+		vAlpha[k] = T::Mask(masks.alpha[k]);
+	}
+
+	const V vZero = T::Zero();
+	const V vWeightRG = T::Set32((GRAY_WEIGHT_G << 16) | GRAY_WEIGHT_R);
+	const V vWeightB = T::Set32(GRAY_WEIGHT_B);
+	const V vRounding = T::Set32(GRAY_ROUNDING);
+	//the threshold comes clamped to -1..255, with -1 every gray is above it
+	const V vThreshold = T::Set8((char)std::max(iThreshold, 0));
+	const V vAllAbove = T::Set8((iThreshold < 0) ? 1 : 0);
+	const V vOne = T::Set8(1);
+
+	while (iPixels >= iBlock)
+	{
+		V vSrc[4];
+		V vR = vZero, vG = vZero, vB = vZero, vA = vZero;
+
+		for (int k = 0; k < iSamplesPerPixel; k++)
+		{
+			vSrc[k] = T::Load(pPixels, iSamplesPerPixel, k);
+			vR = T::Or(vR, T::Shuffle(vSrc[k], vPick[k][0]));
+			vG = T::Or(vG, T::Shuffle(vSrc[k], vPick[k][1]));
+			vB = T::Or(vB, T::Shuffle(vSrc[k], vPick[k][2]));
+			if (iGraySamples == 2)
+				vA = T::Or(vA, T::Shuffle(vSrc[k], vPick[k][3]));
+		}
+
+		//16 bit R,G pairs and B,0 pairs, one madd per pair gives the weighted sums in 32 bit
+		V vRG[2] = { T::UnpackLo8(vR, vZero), T::UnpackHi8(vR, vZero) };
+		V vGG[2] = { T::UnpackLo8(vG, vZero), T::UnpackHi8(vG, vZero) };
+		V vBB[2] = { T::UnpackLo8(vB, vZero), T::UnpackHi8(vB, vZero) };
+		V vSum[4];
+
+		for (int h = 0; h < 2; h++)
+		{
+			vSum[2 * h] = T::Add32(T::Madd16(T::UnpackLo16(vRG[h], vGG[h]), vWeightRG), T::Madd16(T::UnpackLo16(vBB[h], vZero), vWeightB));
+			vSum[2 * h + 1] = T::Add32(T::Madd16(T::UnpackHi16(vRG[h], vGG[h]), vWeightRG), T::Madd16(T::UnpackHi16(vBB[h], vZero), vWeightB));
+		}
+
+		for (int i = 0; i < 4; i++)
+			vSum[i] = T::Shr15(T::Add32(vSum[i], vRounding));
+
+		V vGray = T::Packus16(T::Packs32(vSum[0], vSum[1]), T::Packs32(vSum[2], vSum[3]));
+
+		//gray > threshold leaves a non zero difference, which becomes 0xFF
+		if (bToBinary)
+			vGray = T::Sub8(vZero, T::MinU8(T::Or(T::SubsU8(vGray, vThreshold), vAllAbove), vOne));
+
+		//the lanes of a register are stored iGraySamples * 16 bytes apart, which keeps the pixels in order.
+		//all of the block is loaded before anything is stored
+		if (bSpread)
+		{
+			for (int k = 0; k < iSamplesPerPixel; k++)
+			{
+				V vOut = T::Shuffle(vGray, vSpread[k]);
+				if (iSamplesPerPixel == 4)
+					vOut = T::Or(vOut, T::And(vSrc[k], vAlpha[k]));
+
+				T::Store(pGray, iSamplesPerPixel, k, vOut);
+			}
+		}
+		else if (iGraySamples == 2)
+		{
+			T::Store(pGray, 2, 0, T::UnpackLo8(vGray, vA));
+			T::Store(pGray, 2, 1, T::UnpackHi8(vGray, vA));
+		}
+		else
+			T::Store(pGray, 1, 0, vGray);
+
+		pPixels += iBlock * iSamplesPerPixel;
+		pGray += iBlock * iGraySamples;
+		iPixels -= iBlock;
+	}
+}
+
+static TIFF_TARGET("ssse3") void GrayBlocksSSSE3(const unsigned char*& pPixels, unsigned char*& pGray, size_t& iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	GrayBlocks<SSSE3Ops>(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+}
+
+static TIFF_TARGET("avx2") void GrayBlocksAVX2(const unsigned char*& pPixels, unsigned char*& pGray, size_t& iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	GrayBlocks<AVX2Ops>(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+}
+
+static TIFF_TARGET("avx512f,avx512bw") void GrayBlocksAVX512(const unsigned char*& pPixels, unsigned char*& pGray, size_t& iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	GrayBlocks<AVX512Ops>(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+}
+
+static CTiffPixelKernels::m_eCpuLevel DetectCpuLevel()
+{
+#ifdef _MSC_VER
+	int info[4] = { 0 };
+
+	__cpuid(info, 0);
+	int iMaxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool bSSSE3 = (info[2] & (1 << 9)) != 0;
+	bool bOSXSave = (info[2] & (1 << 27)) != 0;
+	bool bAVX = (info[2] & (1 << 28)) != 0;
+
+	//the OS has to save the ymm/zmm registers too
+	unsigned long long iXCR0 = bOSXSave ? _xgetbv(0) : 0;
+	bool bYmm = ((iXCR0 & 0x06) == 0x06);
+	bool bZmm = ((iXCR0 & 0xE6) == 0xE6);
+
+	bool bAVX2 = false, bAVX512 = false;
+	if (iMaxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		bAVX2 = bAVX && bYmm && ((info[1] & (1 << 5)) != 0);
+		bAVX512 = bAVX2 && bZmm && ((info[1] & (1 << 16)) != 0) && ((info[1] & (1 << 30)) != 0);
+	}
+
+	if (bAVX512)
+		return CTiffPixelKernels::AVX512;
+	if (bAVX2)
+		return CTiffPixelKernels::AVX2;
+	if (bSSSE3)
+		return CTiffPixelKernels::SSSE3;
+#else
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return CTiffPixelKernels::AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return CTiffPixelKernels::AVX2;
+	if (__builtin_cpu_supports("ssse3"))
+		return CTiffPixelKernels::SSSE3;
+#endif
+
+	return CTiffPixelKernels::SCALAR;
+}
+
+#else
+
+static CTiffPixelKernels::m_eCpuLevel DetectCpuLevel()
+{
+	return CTiffPixelKernels::SCALAR;
+}
+
+#endif
+
+//runs the blocks of the cpu level, the pixels left over are up to the caller
+static void GrayBlocksSIMD(const unsigned char*& pPixels, unsigned char*& pGray, size_t& iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+#ifdef TIFF_SIMD_X86
+	if ((iSamplesPerPixel != 3) && (iSamplesPerPixel != 4))
+		return;
+
+	switch (CTiffPixelKernels::GetCpuLevel())
+	{
+	case CTiffPixelKernels::AVX512:
+		GrayBlocksAVX512(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+		break;
+	case CTiffPixelKernels::AVX2:
+		GrayBlocksAVX2(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+		break;
+	case CTiffPixelKernels::SSSE3:
+		GrayBlocksSSSE3(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+		break;
+	default:
+		break;
+	}
+#endif
+}
+
+void CTiffPixelKernels::ToGray(unsigned char* pPixels, size_t iPixels, int iSamplesPerPixel, bool bToBinary, int iThreshold)
+{
+	//no gray is below 0, every gray is at or below 255
+	iThreshold = std::min(std::max(iThreshold, -1), 255);
+
+	const unsigned char* pSource = pPixels;
+	GrayBlocksSIMD(pSource, pPixels, iPixels, iSamplesPerPixel, iSamplesPerPixel, bToBinary, iThreshold);
+
+	//the pixels left over by the SIMD blocks
+	ToGrayScalar(pPixels, iPixels, iSamplesPerPixel, bToBinary, iThreshold);
+}
+
+void CTiffPixelKernels::ToGrayPacked(const unsigned char* pPixels, unsigned char* pGray, size_t iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	if ((iGraySamples == 2) && (iSamplesPerPixel != 4))
+		iGraySamples = 1;
+
+	iThreshold = std::min(std::max(iThreshold, -1), 255);
+
+	GrayBlocksSIMD(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+
+	//the pixels left over by the SIMD blocks
+	ToGrayPackedScalar(pPixels, pGray, iPixels, iSamplesPerPixel, iGraySamples, bToBinary, iThreshold);
+}
+
+bool CTiffPixelKernels::IsBlank(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iSamplesPerPixel)
+{
+#ifdef TIFF_SIMD_X86
+	bool bBlank = true;
+
+	//64 bytes are whole pixels for 1, 2 and 4 samples, for 3 samples every byte is looked at
+	switch (GetCpuLevel())
+	{
+	case AVX512:
+		bBlank = BlankBlocksAVX512(pData, iBytes, iWhite, iSamplesPerPixel);
+		break;
+	case AVX2:
+		bBlank = BlankBlocksAVX2(pData, iBytes, iWhite, iSamplesPerPixel);
+		break;
+	case SSSE3:
+		bBlank = BlankBlocksSSE2(pData, iBytes, iWhite, iSamplesPerPixel);
+		break;
+	default:
+		break;
+	}
+
+	if (!bBlank)
+		return false;
+#endif
+
+	//the bytes left over by the SIMD blocks
+	return IsBlankScalar(pData, iBytes, iWhite, iSamplesPerPixel);
+}
+
+uint64_t CTiffPixelKernels::CountInk(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel, uint64_t iStopAfter)
+{
+	uint64_t iInk = 0;
+	iTolerance = std::min(std::max(iTolerance, 0), 255);
+
+#ifdef TIFF_SIMD_X86
+	switch (GetCpuLevel())
+	{
+	case AVX512:
+		iInk = InkBlocksAVX512(pData, iBytes, iWhite, iTolerance, iSamplesPerPixel, iStopAfter);
+		break;
+	case AVX2:
+		iInk = InkBlocksAVX2(pData, iBytes, iWhite, iTolerance, iSamplesPerPixel, iStopAfter);
+		break;
+	case SSSE3:
+		iInk = InkBlocksSSE2(pData, iBytes, iWhite, iTolerance, iSamplesPerPixel, iStopAfter);
+		break;
+	default:
+		break;
+	}
+
+	if (iInk > iStopAfter)
+		return iInk;
+#endif
+
+	//the bytes left over by the SIMD blocks
+	return iInk + CountInkScalar(pData, iBytes, iWhite, iTolerance, iSamplesPerPixel);
+}
+
+void CTiffPixelKernels::PackBits(const unsigned char* pGray, unsigned char* pBits, size_t iPixels, int iThreshold)
+{
+	//no gray is below 0, every gray is at or below 255
+	iThreshold = std::min(std::max(iThreshold, -1), 255);
+	if (iThreshold < 0)
+	{
+		memset(pBits, 0, (iPixels + 7) / 8);
+		return;
+	}
+
+#ifdef TIFF_SIMD_X86
+	switch (GetCpuLevel())
+	{
+	case AVX512:
+		BitBlocksAVX512(pGray, pBits, iPixels, iThreshold);
+		break;
+	case AVX2:
+		BitBlocksAVX2(pGray, pBits, iPixels, iThreshold);
+		break;
+	case SSSE3:
+		BitBlocksSSSE3(pGray, pBits, iPixels, iThreshold);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	//the pixels left over by the SIMD blocks
+	PackBitsScalar(pGray, pBits, iPixels, iThreshold);
+}
+
+CTiffPixelKernels::m_eCpuLevel CTiffPixelKernels::GetCpuLevel()
+{
+	static const m_eCpuLevel eLevel = DetectCpuLevel();
+	return eLevel;
+}
+
+std::string CTiffPixelKernels::GetCpuLevelName()
+{
+	switch (GetCpuLevel())
+	{
+	case AVX512:
+		return "AVX-512BW";
+	case AVX2:
+		return "AVX2";
+	case SSSE3:
+		return "SSSE3";
+	default:
+		return "scalar";
+	}
+}
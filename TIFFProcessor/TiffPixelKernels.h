@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+//pixel kernels with SSE2/SSSE3, AVX2 and AVX-512BW variants, the variant is chosen once from cpuid.
+//every variant gives exactly the output of the scalar code.
+class CTiffPixelKernels
+{
+public:
+	typedef enum CpuLevel { SCALAR = 0, SSSE3, AVX2, AVX512 } m_eCpuLevel;
+
+	//gray = (9794*R + 19235*G + 3736*B + 16384) >> 15, the weights are 0.2989/0.5870/0.1140 in Q15.
+	//gray pixels(R == G == B) keep their value. bToBinary turns gray into 0xFF(gray > iThreshold) or 0.
+	//pPixels holds iPixels interleaved 8 bit RGB(iSamplesPerPixel 3) or RGBA(4) pixels, alpha is left as it is
+	static void ToGray(unsigned char* pPixels, size_t iPixels, int iSamplesPerPixel, bool bToBinary = false, int iThreshold = 0);
+	static void ToGrayScalar(unsigned char* pPixels, size_t iPixels, int iSamplesPerPixel, bool bToBinary = false, int iThreshold = 0);
+
+	//the same gray, packed into pGray with iGraySamples bytes per pixel: gray(1) or gray and alpha(2, RGBA input only).
+	//pGray may be pPixels, the packed pixels never overtake the ones still to be read
+	static void ToGrayPacked(const unsigned char* pPixels, unsigned char* pGray, size_t iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary = false, int iThreshold = 0);
+	static void ToGrayPackedScalar(const unsigned char* pPixels, unsigned char* pGray, size_t iPixels, int iSamplesPerPixel, int iGraySamples, bool bToBinary = false, int iThreshold = 0);
+
+	//true when every byte of pData is iWhite, it returns at the first 64 byte block with ink.
+	//iSamplesPerPixel 2 or 4 marks the last byte of each pixel as alpha, alpha is not looked at
+	static bool IsBlank(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iSamplesPerPixel = 1);
+	static bool IsBlankScalar(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iSamplesPerPixel = 1);
+
+	//counts the bytes of pData that differ from iWhite by more than iTolerance, alpha is skipped as in IsBlank.
+	//the count may stop early once it is above iStopAfter
+	static uint64_t CountInk(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel = 1, uint64_t iStopAfter = UINT64_MAX);
+	static uint64_t CountInkScalar(const unsigned char* pData, size_t iBytes, unsigned char iWhite, int iTolerance, int iSamplesPerPixel = 1);
+
+	//counts the bits of 1 bit pixels that differ from iWhite(0x00 or 0xFF)
+	static uint64_t CountInkBits(const unsigned char* pData, size_t iBytes, unsigned char iWhite);
+
+	//packs 8 bit gray into 1 bit pixels, 8 per byte with the first pixel in the high bit. the bit is set for gray
+	//at or below iThreshold(black on MINISWHITE pages), the bits after the last pixel are 0. pBits may be pGray
+	static void PackBits(const unsigned char* pGray, unsigned char* pBits, size_t iPixels, int iThreshold);
+	static void PackBitsScalar(const unsigned char* pGray, unsigned char* pBits, size_t iPixels, int iThreshold);
+
+	//adds the bytes of pData to a histogram of 256 counters
+	static void AddToHistogram(const unsigned char* pData, size_t iBytes, uint64_t* pHistogram);
+
+	//Otsu threshold of a gray histogram, the gray that best splits it into dark(at or below it) and light
+	static int GetOtsuThreshold(const uint64_t* pHistogram);
+
+	static m_eCpuLevel GetCpuLevel();
+	static std::string GetCpuLevelName();
+};
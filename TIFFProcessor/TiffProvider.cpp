@@ -1,5 +1,39 @@
 #include "TiffProvider.h"
 
+//the output is written as BigTIFF well before it could reach the 4GB classic TIFF limit,
+//the estimate doesnt cover the tags and the compression ratio of decoded pages is a guess
+static const uint64_t BIGTIFF_THRESHOLD = 0xF0000000;
+static const uint64_t DIRECTORY_RESERVE = 4096;
+
+//strips of at least this many rows are checked for ink in their top eighth before being decoded whole,
+//when the page may not have more ink than that
+static const uint32_t BLANK_PROBE_ROWS = 256;
+
+//pages done by the workers of the page engine wait in memory for the writer,
+//the workers stay at most this many pages per thread ahead of it
+static const uint32_t PAGE_LOOKAHEAD = 2;
+
+//compressed size of a page in parts of its decoded size. clean blank pages stay below _dBlank,
+//pages above _dInk cant be clean blank. the values hold for usual codec settings, pages in between are decoded
+typedef struct SizeLimits
+{
+	uint16_t _compression;
+	double _dBlank;
+	double _dInk;
+}SizeLimits;
+
+static const SizeLimits BLANK_SIZE_LIMITS[] =
+{
+	{ COMPRESSION_CCITTRLE, 0.015, 0.05 },
+	{ COMPRESSION_CCITTFAX3, 0.015, 0.05 },
+	{ COMPRESSION_CCITTFAX4, 0.004, 0.05 },
+	{ COMPRESSION_JPEG, 0.006, 0.08 },
+	{ COMPRESSION_OJPEG, 0.006, 0.08 },
+	{ COMPRESSION_LZW, 0.025, 0.2 },
+	{ COMPRESSION_ADOBE_DEFLATE, 0.006, 0.1 },
+	{ COMPRESSION_DEFLATE, 0.006, 0.1 },
+	{ COMPRESSION_PACKBITS, 0.02, 0.2 }
+};
 
 
 CTiffProvider::CTiffProvider(TIFFParams& Params) : m_strInputFile(""), m_strOutputFile(""), m_bUseTempOutfile(false),
@@ -17,64 +51,229 @@ CTiffProvider::~CTiffProvider()
 }
 
 //PRIVATE MEMBERS
-bool CTiffProvider::OpenIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bDeleteOutputFile)
+TIFF* CTiffProvider::OpenInputFile(const std::string& strFile, CTiffMappedFile::m_eAccessHint eHint)
+{
+	//map the input file, fall back to the stdio procs if it cant be mapped(e.g. 2GB+ files in a 32 bit process)
+	TIFF* pInfile = CTiffMappedFile::Open(strFile, eHint);
+	if (!pInfile)
+		pInfile = TIFFOpen(strFile.c_str(), "r");
+
+	return pInfile;
+}
+
+bool CTiffProvider::OpenIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bDeleteOutputFile, bool bConvert, uint64_t iAppendedSize)
 {
-	*pInfile = TIFFOpen(m_strInputFile.c_str(), "r");
+	*pInfile = OpenInputFile(m_strInputFile);
 	if (!*pInfile)
 	{
 		m_strErrorMsg = "Error opening input file: " + m_strInputFile;
 		return false;
 	}
 
+	//an existing output file keeps its format, a new one is created as BigTIFF if it may pass 4GB
+	const char* pMode = "a";
+
 	//create temp out file if no output file is given, if given, delete the old one and create new
 	if (bDeleteOutputFile)
 	{
+		if (UseBigTIFF(EstimateOutputSize(*pInfile, bConvert) + iAppendedSize))
+			pMode = "a8";
+
+
 		if (m_strOutputFile.empty())
 		{
-			//m_strOutputFile = m_strFilesPath + "tiff_temp.tif";
+			//the temp file replaces the input file in CloseIOFiles
+			m_strOutputFile = GetTempFile(m_strInputFile);
 			m_bUseTempOutfile = true;
 		}
-		else
-		{
-			std::remove(m_strOutputFile.c_str());
-		}
+
+		std::remove(m_strOutputFile.c_str());
 	}
 
-	*pOutfile = TIFFOpen(m_strOutputFile.c_str(), "a");
+	*pOutfile = TIFFOpen(m_strOutputFile.c_str(), pMode);
 	if (!*pOutfile)
 	{
 		m_strErrorMsg = "Error creating temporary file: " + m_strOutputFile;
+		TIFFClose(*pInfile);
+		*pInfile = nullptr;
+		m_bUseTempOutfile = false;
 		return false;
 	}
 
 	return true;
 }
 
-void CTiffProvider::CloseIOFiles(TIFF** pInfile, TIFF** pOutfile)
+void CTiffProvider::CloseIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bCommit)
 {
 	TIFFClose(*pInfile);
 	TIFFClose(*pOutfile);
 
+	//a failed operation must not replace the input file with a partial output
 	if (m_bUseTempOutfile)
 	{
-		std::remove(m_strInputFile.c_str());
-		std::rename(m_strOutputFile.c_str(), m_strInputFile.c_str());
+		if (bCommit)
+		{
+			std::remove(m_strInputFile.c_str());
+			std::rename(m_strOutputFile.c_str(), m_strInputFile.c_str());
+		}
+		else
+		{
+			std::remove(m_strOutputFile.c_str());
+		}
 	}
 
 	m_bUseTempOutfile = false;
 }
 
+std::string CTiffProvider::GetTempFile(const std::string& strFile)
+{
+	return strFile + ".tmp";
+}
+
+bool CTiffProvider::OpenIOBuffers(const unsigned char* pData, size_t iSize, std::vector<unsigned char>& outBuffer, TIFF** pInfile, TIFF** pOutfile, const char* pMode, bool bConvert)
+{
+	//a failed call leaves no output, not even a copy made for appending
+	*pInfile = CTiffMemoryStream::OpenRead(pData, iSize);
+	if (!*pInfile)
+	{
+		m_strErrorMsg = "Error opening input buffer!!";
+		outBuffer.clear();
+		return false;
+	}
+
+	//a new output buffer is written as BigTIFF if it may pass 4GB
+	std::string strMode = pMode;
+	if ((strMode == "w") && UseBigTIFF(EstimateOutputSize(*pInfile, bConvert)))
+		strMode = "w8";
+
+	*pOutfile = CTiffMemoryStream::OpenWrite(outBuffer, strMode.c_str());
+	if (!*pOutfile)
+	{
+		m_strErrorMsg = "Error creating output buffer!!";
+		TIFFClose(*pInfile);
+		*pInfile = nullptr;
+		outBuffer.clear();
+		return false;
+	}
+
+	return true;
+}
+
 uint16_t CTiffProvider::GetPageCount(TIFF* tif)
 {
 	//returns number images in a multipage TIFF file.
-	uint16_t dircount = 0;
+	//the IFD chain is walked only once, the pages are then visited through the page index
+	if (!m_PageIndex.Build(tif))
+		return 0;
+
+	return (uint16_t)m_PageIndex.GetPageCount();
+}
+
+uint64_t CTiffProvider::EstimateOutputSize(TIFF* pInfile, bool bConvert)
+{
+	uint64_t iSize = 0;
+
+	uint16_t iPageCount = GetPageCount(pInfile);
+
+	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+	{
+		if (!m_PageIndex.SetPage(pageno))
+			continue;
+
+		iSize += DIRECTORY_RESERVE;
+
+		//raw copied pages take exactly the bytes of their strips(or tiles)
+		uint64* pByteCounts = nullptr;
+		uint64_t iRawSize = 0;
+		bool bTiled = (TIFFIsTiled(pInfile) != 0);
+		uint32_t iChunks = bTiled ? TIFFNumberOfTiles(pInfile) : TIFFNumberOfStrips(pInfile);
+
+		if (TIFFGetField(pInfile, bTiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &pByteCounts) && pByteCounts)
+		{
+			for (uint32_t chunk = 0; chunk < iChunks; chunk++)
+				iRawSize += pByteCounts[chunk];
+		}
+
+		if (!bConvert && m_Params._bRawCopy)
+		{
+			iSize += iRawSize;
+			continue;
+		}
+
+		//decoded pages are encoded again with the compression of the page,
+		//only JPEG is assumed to compress scanned images reliably
+		GetTagInfo(pInfile);
+		uint64_t iDecodedSize = (uint64_t)TIFFScanlineSize64(pInfile) * m_TagHeader._height;
+		if (m_TagHeader._compression == COMPRESSION_JPEG)
+			iDecodedSize /= 4;
+
+		iSize += std::max(iRawSize, iDecodedSize);
+	}
+
+	return iSize;
+}
+
+uint64_t CTiffProvider::EstimateOutputSize(const std::vector<std::string>& vFiles)
+{
+	uint64_t iSize = 0;
+
+	for (auto& strFile : vFiles)
+	{
+		TIFF* pInfile = OpenInputFile(strFile);
+		if (!pInfile)
+			continue;
+
+		iSize += EstimateOutputSize(pInfile, false);
+		TIFFClose(pInfile);
+	}
+
+	return iSize;
+}
+
+bool CTiffProvider::UseBigTIFF(uint64_t iEstimatedSize)
+{
+	if (m_Params._strBigTIFF == "always")
+		return true;
+
+	if (m_Params._strBigTIFF == "never")
+		return false;
+
+	return (iEstimatedSize > BIGTIFF_THRESHOLD);
+}
+
+bool CTiffProvider::MergeToBigTIFF(std::string& infile1, std::vector<std::string>& vInfiles, uint64_t iAppendedSize)
+{
+	bool bRes = true;
+
+	//a classic TIFF cant be extended past 4GB, so infile1 is rewritten as BigTIFF to a temp file
+	//together with the appended files and then replaced by it
+	m_strInputFile = infile1;
+	m_strOutputFile = "";
+
+	TIFF* pInfile1 = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOFiles(&pInfile1, &pOutfile, true, false, iAppendedSize))
+		return false;
+
+	bRes = ProcessMerge(pInfile1, pOutfile);
 
-	do
+	for (size_t i = 0; bRes && (i < vInfiles.size()); i++)
 	{
-		dircount++;
-	} while (TIFFReadDirectory(tif));
+		TIFF* pInfile2 = OpenInputFile(vInfiles[i]);
+		if (!pInfile2)
+		{
+			m_strErrorMsg = "Error opening input file: " + vInfiles[i];
+			bRes = false;
+			break;
+		}
+
+		bRes = ProcessMerge(pInfile2, pOutfile);
+		TIFFClose(pInfile2);
+	}
 
-	return dircount;
+	CloseIOFiles(&pInfile1, &pOutfile, bRes);
+	return bRes;
 }
 
 TIFFParams& CTiffProvider::GetTIFFParams()
@@ -128,332 +327,1597 @@ int16_t CTiffProvider::WriteHeader(TIFF* tif, TagHeader& header)
 bool CTiffProvider::WriteData(TIFF* pInfile, TIFF* pOutfile)
 {
 	bool bRes = true;
-	
-	if (!WriteHeader(pOutfile, m_TagHeader))
+
+	//pages that are copied unchanged dont need a decode/encode round trip
+	if (!m_bToGrayScale && !m_bToBinary && m_Params._bRawCopy)
+		return CopyRawData(pInfile, pOutfile);
+
+	//gray pages are written with one sample per pixel(two with alpha),
+	//binary pages as 1 bit MINISWHITE pixels with CCITT G4
+	TagHeader header = m_TagHeader;
+	int iGraySamples = GetGraySamples();
+	bool bConvert = m_bToGrayScale || m_bToBinary;
+	int iOutPixelBits = m_bToBinary ? 1 : 8 * iGraySamples;
+
+	if (bConvert)
+	{
+		header._samplesperpixel = (uint16_t)iGraySamples;
+		header._photometric = PHOTOMETRIC_MINISBLACK;
+	}
+
+	if (m_bToBinary)
+	{
+		header._bitspersample = 1;
+		header._photometric = PHOTOMETRIC_MINISWHITE;
+		header._compression = COMPRESSION_CCITTFAX4;
+	}
+
+	if (!WriteHeader(pOutfile, header))
 	{
 		m_strErrorMsg = "Error writing the tag header info!!";
 		return false;
 	}
 
-	//allocate memory for image by linesize (width * samplesperpixel)
-	tmsize_t lineSize = TIFFScanlineSize(pInfile);
-	unsigned char* pSourceImage = (unsigned char*)_TIFFmalloc(lineSize);
-	
-	//scan lines one by one in the current page and write to output page
-	for (uint16_t row = 0; row < m_TagHeader._height; row++)
+	if (bConvert && (iGraySamples == 2))
 	{
-		if (TIFFReadScanline(pInfile, pSourceImage, row) < 1)
-		{
-			_TIFFfree(pSourceImage);
-			return false;
-		}
-		
-		if (m_bToGrayScale || m_bToBinary)
-		{
-			if (m_bToGrayScale)
-				ToGrayScale(pSourceImage, lineSize, m_TagHeader._samplesperpixel);
-	
-			if (m_bToBinary)
-				ToGrayScale(pSourceImage, lineSize, m_TagHeader._samplesperpixel, true, m_Params._iThreshold);
-	
-			if (TIFFWriteScanline(pOutfile, pSourceImage, row, 0) < 0)
-			{
-				bRes = false;
-				break;
-			}
-		}
-		else
-		{
-			if (TIFFWriteScanline(pOutfile, pSourceImage, row, 0) < 0)
-			{
-				bRes = false;
-				break;
-			}
-		}
+		uint16 iCount = 0;
+		uint16* pExtraSamples = nullptr;
+		uint16 iAlpha = EXTRASAMPLE_UNASSALPHA;
+		if (TIFFGetField(pInfile, TIFFTAG_EXTRASAMPLES, &iCount, &pExtraSamples) && (iCount > 0))
+			iAlpha = pExtraSamples[0];
+		TIFFSetField(pOutfile, TIFFTAG_EXTRASAMPLES, 1, &iAlpha);
 	}
 
-	TIFFFlush(pOutfile);
-	_TIFFfree(pSourceImage);
+	//decode the page a strip(or tile) at a time
+	CTiffStripReader reader;
+	CTiffStripWriter writer;
 
-	return bRes;
-}
+	if (!reader.Open(pInfile))
+		return false;
 
-bool CTiffProvider::IsPageType(TIFF* pFile, m_ePageType pType)
-{
-	bool bResult = true;
-	bool bColourPage = false;
-	int iSamplesPerPixel = m_TagHeader._samplesperpixel;
+	uint32_t iRowsPerStrip = 0, iTileWidth = 0, iTileLength = 0;
+	GetOutputLayout(pOutfile, reader, iRowsPerStrip, iTileWidth, iTileLength);
 
-	//usually white pixels have value 0xFF(255)
-	uint16_t iWhitePixel = (m_TagHeader._photometric == PHOTOMETRIC_MINISWHITE) ? 0x00 : 0xFF;
+	bool bWriterOpen = (iTileWidth != 0) ? writer.OpenTiled(pOutfile, iTileWidth, iTileLength) : writer.Open(pOutfile, iRowsPerStrip);
+	if (!bWriterOpen)
+		return false;
 
-	//For RGB/Grayscale with 3 samples per pixel.
-	/*if (!ValidPixelFormat())
-		return false;*/
+	//with the layout of the input the chunks are encoded as they are decoded, otherwise they are regrouped by the writer
+	bool bSameLayout = reader.IsTiled() ? ((iTileWidth == reader.GetChunkWidth()) && (iTileLength == reader.GetChunkLength()))
+										: ((iTileWidth == 0) && (iRowsPerStrip == reader.GetChunkLength()));
+	//the converted rows are packed in place, every row starts at the row size of the output
+	tmsize_t iRowSize = bConvert ? ((reader.GetRowSize() / m_TagHeader._samplesperpixel) * iOutPixelBits + 7) / 8 : reader.GetRowSize();
+	if (bSameLayout && (writer.GetRowSize() != iRowSize))
+		return false;
+
+	//the threshold of Otsu comes from the whole page, so its page is kept as 8 bit gray(a third of the decoded size)
+	//until it is complete. the area around each pixel(Sauvola, Bradley) and the error diffusion only need the rows
+	//near the current ones, the gray rows of every row of chunks are streamed into the binarizer and its bit rows
+	//are written as they come. the page is decoded once either way
+	bool bWholePage = m_bToBinary && (m_Params._strBinarize == "otsu");
+	bool bStreamed = m_bToBinary && !bWholePage && (m_Params._strBinarize != "fixed");
+
+	uint64_t histogram[256] = { 0 };
+	std::vector<unsigned char> vGray;
+	size_t iBitStride = ((size_t)m_TagHeader._width + 7) / 8;
+
+	//the bit rows go to the writer, which cuts them into the strips or tiles of the output
+	auto fnRows = [&](uint32_t y, uint32_t iRows, const unsigned char* pBits, size_t iStride)
+	{
+		return writer.AddRegion(0, y, iRows, iBitStride, pBits, iStride) && writer.FlushRows(y + iRows);
+	};
+
+	CTiffBinarizer::m_eMethod method = GetBinarizeMethod();
+	double dK = (method == CTiffBinarizer::BRADLEY) ? m_Params._iBradleyPercent / 100.0 : m_Params._dSauvolaK;
+	CTiffBinarizer binarizer(method, m_Params._iBinarizeWindow, dK, m_Params._iThreads);
+
+	//a streamed page holds the gray of one row of chunks
+	if (bWholePage)
+		vGray.resize((size_t)m_TagHeader._width * m_TagHeader._height);
+	else if (bStreamed)
+	{
+		vGray.resize((size_t)m_TagHeader._width * reader.GetChunkLength());
+		binarizer.Begin(m_TagHeader._width, m_TagHeader._height, fnRows);
+	}
 
-	tmsize_t lineSize = TIFFScanlineSize(pFile);
-	unsigned char* sourceImage = (unsigned char*)_TIFFmalloc(lineSize);
+	//chunks of the layout of the output are encoded on the workers, others are regrouped by the writer
+	//and the gray rows for the binarization are collected in page order
+	m_eChunkOutput eOutput = (bWholePage || bStreamed) ? GRAY_CHUNK : (bSameLayout ? ENCODED_CHUNK : DECODED_CHUNK);
 
-	//scan lines one by one in the current page 
-	for (uint16_t row = 0; row < m_TagHeader._height; row++)
+	auto fnChunk = [&](const ChunkInfo& info, unsigned char* pData)
 	{
-		if (TIFFReadScanline(pFile, sourceImage, row) < 0)
+		if (eOutput != GRAY_CHUNK)
+			return WriteChunk(writer, bSameLayout, info, pData, iRowSize);
+
+		uint32_t iGrayTop = bWholePage ? info._y : 0;
+		for (uint32_t row = 0; row < info._rows; row++)
 		{
-			_TIFFfree(sourceImage);
-			return false;
+			unsigned char* pGrayRow = vGray.data() + (size_t)(iGrayTop + row) * m_TagHeader._width + info._x;
+			memcpy(pGrayRow, pData + row * info._rowBytes, info._rowBytes);
+			if (bWholePage)
+				CTiffPixelKernels::AddToHistogram(pGrayRow, info._rowBytes, histogram);
 		}
 
-		//Check for page type (GRAYSCAL, COLOUR, BLANK)
-		for (int index = 0; index < lineSize; index += iSamplesPerPixel)
+		//the rows are complete once the last chunk across the page is in
+		if (bStreamed && (info._x + info._width >= m_TagHeader._width))
+			return binarizer.AddRows(vGray.data(), m_TagHeader._width, info._rows);
+
+		return true;
+	};
+
+	//the chunks are read, decoded and written on their own threads. a single worker(one thread or one chunk)
+	//would gain nothing for the open of the input, the mapping and the read thread it costs on every page
+	std::vector<TIFF*> vInputs;
+	unsigned iWorkers = GetThreads(reader.GetChunkCount());
+	if ((iWorkers > 1) && OpenChunkInputs(pInfile, iWorkers, vInputs))
+	{
+		bRes = WriteChunksParallel(pOutfile, reader, vInputs, iRowSize, iOutPixelBits, eOutput, fnChunk);
+
+		for (TIFF* pInput : vInputs)
+			TIFFClose(pInput);
+	}
+	else
+	{
+		//the page is done on this thread with one worker or if the input cant be opened again
+		std::vector<unsigned char> vChunk;
+
+		for (uint32_t chunk = 0; (chunk < reader.GetChunkCount()) && bRes; chunk++)
 		{
-			if (pType == m_ePageType::BLANK)
-			{
-				if (sourceImage[index] != iWhitePixel)
-				{
-					bResult = false;
-					break;
-				}
-			}
-			else if ((pType == m_ePageType::COLOUR) || (pType == m_ePageType::GRAYSCALE))
+			if (!reader.ReadChunk(chunk))
 			{
-				//if samples per pixel == 3, RGB values should not be same
-				unsigned char ch = sourceImage[index];
-				unsigned char ch1 = sourceImage[index + 1];
-				unsigned char ch2 = sourceImage[index + 2];
-				if((ch | ch1 | ch2) != (ch & ch1 & ch2 ))
-				{
-					bColourPage = true;
-					break;
-				}
-			}
-			//else if (pType == m_ePageType::BINARY)
-			//{
-			//	if ((sourceImage[index] != 0xFF) && (sourceImage[index] != 0x00))
-			//	{
-			//		bResult = false;
-			//		//break;
-			//	}
-			//}
-
-			if (!bResult)
+				bRes = false;
 				break;
+			}
+
+			ChunkInfo info = { chunk, reader.GetChunkX(), reader.GetChunkY(), reader.GetChunkWidth(), reader.GetRowsInChunk(), reader.GetRowBytesInChunk(), reader.GetChunkSize() };
+			bRes = fnChunk(info, PrepareChunk(reader, info, eOutput == GRAY_CHUNK, iRowSize, iOutPixelBits, vChunk));
 		}
 	}
 
-	_TIFFfree(sourceImage);
+	if (bRes && bWholePage)
+	{
+		//the bits are packed into the gray page, a row of bits never reaches the gray row after it
+		int iThreshold = CTiffPixelKernels::GetOtsuThreshold(histogram);
+		for (uint32_t y = 0; y < m_TagHeader._height; y++)
+			CTiffPixelKernels::PackBits(vGray.data() + (size_t)y * m_TagHeader._width, vGray.data() + y * iBitStride, m_TagHeader._width, iThreshold);
+
+		//handed to the writer a row of chunks at a time, so it never holds more than that
+		for (uint32_t y = 0; (y < m_TagHeader._height) && bRes; y += reader.GetChunkLength())
+			bRes = fnRows(y, std::min(reader.GetChunkLength(), m_TagHeader._height - y), vGray.data() + y * iBitStride, iBitStride);
+	}
 
-	//if not colour page, it is a grayscale
-	if (pType == m_ePageType::GRAYSCALE)
-		return !bColourPage;
+	TIFFFlush(pOutfile);
 
-	return bResult;
+	return bRes;
 }
 
-bool CTiffProvider::ValidPixelFormat()
+CTiffBinarizer::m_eMethod CTiffProvider::GetBinarizeMethod()
 {
-	//PALETTE type photometric and one channel data are not supported for color converstions
-	if ((m_TagHeader._photometric != PHOTOMETRIC_PALETTE) && (m_TagHeader._samplesperpixel == 3) || (m_TagHeader._samplesperpixel == 4))
-		return true;
-
-	return false;
+	if (m_Params._strBinarize == "bradley")
+		return CTiffBinarizer::BRADLEY;
+	else if (m_Params._strBinarize == "floyd")
+		return CTiffBinarizer::FLOYD_STEINBERG;
+	else if (m_Params._strBinarize == "atkinson")
+		return CTiffBinarizer::ATKINSON;
+
+	return CTiffBinarizer::SAUVOLA;
 }
 
-bool CTiffProvider::ToGrayScale(unsigned char* pSourceImage, uint32_t lineSize, int iSamplesperpixel, bool bToBinary, int iThreshold)
+bool CTiffProvider::WriteChunk(CTiffStripWriter& writer, bool bSameLayout, const ChunkInfo& info, unsigned char* pData, tmsize_t iRowSize)
 {
-	for (uint16_t index = 0; index < lineSize; index += iSamplesperpixel)
-	{
-		unsigned char R = pSourceImage[index];
-		unsigned char G = pSourceImage[index + 1];
-		unsigned char B = pSourceImage[index + 2];
-		unsigned char grayPixel;
+	if (bSameLayout)
+		return writer.WriteChunk(info._index, pData, info._size);
 
-		//if R,G,B have sample values, this is grayscale pixel. So no need to change pixel value
-		if ((R | G | B) != (R & G & B))
-			grayPixel = (unsigned char)(0.2989 * R + 0.5870 * G + 0.1140 * B);
-		else
-			grayPixel = R;  // can also choose G or B values for graypixel
+	if (!writer.AddRegion(info._x, info._y, info._rows, info._rowBytes, pData, iRowSize))
+		return false;
 
-		if (m_bToGrayScale)
-		{
-			pSourceImage[index] = grayPixel;
-			pSourceImage[index + 1] = grayPixel;
-			pSourceImage[index + 2] = grayPixel;
-			if (iSamplesperpixel == 4)
-				pSourceImage[index + 3] = pSourceImage[index + 3]; //write Alpha channel AS IS.
-		}
-		else if (m_bToBinary)
-		{
-			unsigned char binaryPixel = (grayPixel > iThreshold) ? 0xFF : 0;
-			pSourceImage[index] = binaryPixel;
-			pSourceImage[index+1] = binaryPixel;
-			pSourceImage[index+2] = binaryPixel;
-			if (iSamplesperpixel == 4)
-				pSourceImage[index + 3] = pSourceImage[index + 3]; //write Alpha channel AS IS.
-		}
-	}
+	//the rows of the chunk are complete once the last chunk across the page is added
+	if (info._x + info._width >= m_TagHeader._width)
+		return writer.FlushRows(info._y + info._rows);
 
 	return true;
 }
 
-//PUBLIC MEMBERS
-bool CTiffProvider::MergeFiles(std::string& infile1, std::string& infile2)
+void CTiffProvider::ConvertChunk(CTiffStripReader& reader, ChunkInfo& info, tmsize_t iRowSize, int iOutPixelBits)
 {
-	bool bRes = true;
-
-	m_strInputFile = infile2;
-	m_strOutputFile = infile1;
-
-	TIFF* pInfile1 = nullptr;
-	TIFF* pInfile2 = nullptr;
-
-	//we do "inplace merging here". we merge the two files by adding the contents of infile2 to infile1
-	if (!OpenIOFiles(&pInfile2, &pInfile1, false))
-		return false;
+	//the converted rows are packed in place, every row starts at the row size of the output
+	tmsize_t lineSize = info._rowBytes;
+	info._rowBytes = ((lineSize / m_TagHeader._samplesperpixel) * iOutPixelBits + 7) / 8;
+	info._size = (info._size / reader.GetRowSize()) * iRowSize;
 
-	//get the number of pages in the input TIFF file
-	uint16_t iPageCount = GetPageCount(pInfile2);
+	for (uint32_t row = 0; row < info._rows; row++)
+		ToGrayScale(reader.GetChunkRow(row), reader.GetChunk() + row * iRowSize, (uint32_t)lineSize, m_TagHeader._samplesperpixel, GetGraySamples(), m_bToBinary, m_Params._iThreshold);
+}
 
-	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+unsigned char* CTiffProvider::PrepareChunk(CTiffStripReader& decoder, ChunkInfo& info, bool bGray, tmsize_t iRowSize, int iOutPixelBits, std::vector<unsigned char>& vGray)
+{
+	//the kernels only see the pixels inside the page, the padding of edge tiles is left as it is
+	if (!bGray)
 	{
-		if (TIFFSetDirectory(pInfile2, pageno))
-		{
-			GetTagInfo(pInfile2);
+		if (m_bToGrayScale || m_bToBinary)
+			ConvertChunk(decoder, info, iRowSize, iOutPixelBits);
 
-			if (!WriteData(pInfile2, pInfile1))
-			{
-				m_strErrorMsg = "Error writing the data to destination!!";
-				bRes = false;
-				break;
-			}
-		}
+		return decoder.GetChunk();
 	}
 
-	CloseIOFiles(&pInfile1, &pInfile2);
-	return bRes;
+	//8 bit gray rows for the binarization, packed to the pixels of the chunk inside the page
+	tmsize_t lineSize = info._rowBytes;
+	info._rowBytes = lineSize / m_TagHeader._samplesperpixel;
+	vGray.resize((size_t)info._rows * info._rowBytes);
+
+	for (uint32_t row = 0; row < info._rows; row++)
+		ToGrayScale(decoder.GetChunkRow(row), vGray.data() + row * info._rowBytes, (uint32_t)lineSize, m_TagHeader._samplesperpixel, 1);
+
+	return vGray.data();
 }
 
-bool CTiffProvider::RemoveBlankPages(std::string& infile, std::string outfile)
+void CTiffProvider::GetChunkFormat(TIFF* pOutfile, ChunkFormat& format)
 {
-	bool bRes = true;
-	
-	m_strInputFile = infile;
-	m_strOutputFile = outfile;
+	TagHeader& header = format._header;
+	header = TagHeader();
+
+	//the tags as they are set on the output, WriteHeader is not used by the workers as it changes the header
+	TIFFGetField(pOutfile, TIFFTAG_IMAGEWIDTH, &header._width);
+	TIFFGetField(pOutfile, TIFFTAG_IMAGELENGTH, &header._height);
+	TIFFGetFieldDefaulted(pOutfile, TIFFTAG_COMPRESSION, &header._compression);
+	TIFFGetFieldDefaulted(pOutfile, TIFFTAG_PLANARCONFIG, &header._config);
+	TIFFGetField(pOutfile, TIFFTAG_PHOTOMETRIC, &header._photometric);
+	TIFFGetFieldDefaulted(pOutfile, TIFFTAG_BITSPERSAMPLE, &header._bitspersample);
+	TIFFGetFieldDefaulted(pOutfile, TIFFTAG_SAMPLESPERPIXEL, &header._samplesperpixel);
+
+	format._bTiled = (TIFFIsTiled(pOutfile) != 0);
+	format._iTileWidth = 0;
+	format._iTileLength = 0;
+	if (format._bTiled)
+	{
+		TIFFGetField(pOutfile, TIFFTAG_TILEWIDTH, &format._iTileWidth);
+		TIFFGetField(pOutfile, TIFFTAG_TILELENGTH, &format._iTileLength);
+	}
 
-	TIFF* pInfile = nullptr;
-	TIFF* pOutfile = nullptr;
+	uint16 iCount = 0;
+	uint16* pExtraSamples = nullptr;
+	format._vExtraSamples.clear();
+	if (TIFFGetField(pOutfile, TIFFTAG_EXTRASAMPLES, &iCount, &pExtraSamples) && pExtraSamples)
+		format._vExtraSamples.assign(pExtraSamples, pExtraSamples + iCount);
+}
 
-	if (!OpenIOFiles(&pInfile, &pOutfile))
+bool CTiffProvider::EncodeChunk(const ChunkFormat& format, const ChunkInfo& info, unsigned char* pData, std::vector<unsigned char>& vScratch, ChunkSlot& slot)
+{
+	//the chunk is the only strip(or tile) of a scratch TIFF in memory with the tags of the output page,
+	//so libtiff encodes it to the bytes it would have in the page
+	const TagHeader& header = format._header;
+	uint32_t iWidth = format._bTiled ? format._iTileWidth : header._width;
+	uint32_t iHeight = format._bTiled ? format._iTileLength : info._rows;
+
+	TIFF* pFile = CTiffMemoryStream::OpenWrite(vScratch, "w");
+	if (!pFile)
 		return false;
 
-	uint16_t iPageCount = GetPageCount(pInfile);
-
-	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+	TIFFSetField(pFile, TIFFTAG_IMAGEWIDTH, iWidth);
+	TIFFSetField(pFile, TIFFTAG_IMAGELENGTH, iHeight);
+	TIFFSetField(pFile, TIFFTAG_COMPRESSION, header._compression);
+	TIFFSetField(pFile, TIFFTAG_PLANARCONFIG, header._config);
+	TIFFSetField(pFile, TIFFTAG_PHOTOMETRIC, header._photometric);
+	TIFFSetField(pFile, TIFFTAG_BITSPERSAMPLE, header._bitspersample);
+	TIFFSetField(pFile, TIFFTAG_SAMPLESPERPIXEL, header._samplesperpixel);
+	if (!format._vExtraSamples.empty())
+		TIFFSetField(pFile, TIFFTAG_EXTRASAMPLES, (uint16)format._vExtraSamples.size(), format._vExtraSamples.data());
+
+	CTiffStripWriter writer;
+	bool bRes = format._bTiled ? writer.OpenTiled(pFile, iWidth, iHeight) : writer.Open(pFile, iHeight);
+	if (bRes)
+		bRes = writer.WriteChunk(0, pData, info._size);
+
+	//the encoded bytes are cut out of the scratch file
+	uint64* pOffsets = nullptr;
+	uint64* pByteCounts = nullptr;
+	if (bRes)
 	{
-		if (TIFFSetDirectory(pInfile, pageno))
-		{
-			//get the tagheader info from the input file
-			GetTagInfo(pInfile);
+		bRes = TIFFGetField(pFile, format._bTiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS, &pOffsets) &&
+			   TIFFGetField(pFile, format._bTiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &pByteCounts) &&
+			   pOffsets && pByteCounts && (pOffsets[0] + pByteCounts[0] <= vScratch.size());
+	}
 
-			//Is the current page BLANK? If yes, dont process it.
-			if (IsPageType(pInfile, m_ePageType::BLANK))
-				continue;
+	if (bRes)
+		slot._vData.assign(vScratch.begin() + (size_t)pOffsets[0], vScratch.begin() + (size_t)(pOffsets[0] + pByteCounts[0]));
 
-			if (!WriteData(pInfile, pOutfile))
-			{
-				m_strErrorMsg = "Error writing the data to destination!!";
-				bRes = false;
-				break;
-			}
-		}
-	}
+	uint32 iTablesSize = 0;
+	void* pTables = nullptr;
+	slot._vTables.clear();
+	if (bRes && (header._compression == COMPRESSION_JPEG) && TIFFGetField(pFile, TIFFTAG_JPEGTABLES, &iTablesSize, &pTables) && (iTablesSize > 0))
+		slot._vTables.assign((unsigned char*)pTables, (unsigned char*)pTables + iTablesSize);
 
-	CloseIOFiles(&pInfile, &pOutfile);
+	TIFFClose(pFile);
 	return bRes;
 }
 
-bool CTiffProvider::RemovePageByNumber(std::string& infile, std::set<uint16_t>& pNumbers, std::string outfile)
+bool CTiffProvider::WriteChunksParallel(TIFF* pOutfile, CTiffStripReader& reader, std::vector<TIFF*>& vInputs, tmsize_t iRowSize, int iOutPixelBits, m_eChunkOutput eOutput, ChunkFunction fnChunk)
 {
-	bool bRes = true;
+	//a pipeline of three stages: the raw chunks are read in order from the input on a thread of their own,
+	//the workers decode, convert and encode them with their own handle, reader and scratch buffer,
+	//and the chunks are committed in order. the chunks pass through a fixed number of slots,
+	//so the memory of the page in flight is the same for any size of page.
+	//ENCODED chunks are written as they are, the decoded(or gray) rows of the others go to fnChunk
+	unsigned iThreads = (unsigned)vInputs.size();
+	uint32_t iChunks = reader.GetChunkCount();
+	uint32_t iSlots = iThreads * std::max((uint32_t)1, (uint32_t)m_Params._iPipelineDepth);
+	ChunkFormat format;
+	GetChunkFormat(pOutfile, format);
+
+	std::vector<CTiffStripReader> vReaders(iThreads);
+	std::vector<std::vector<unsigned char>> vScratch(iThreads);
+	std::vector<ChunkSlot> vSlots(std::min(iSlots, iChunks));
+	std::vector<unsigned char> vTables;
+	std::string strReadError = "";
+
+	for (unsigned i = 0; i < iThreads; i++)
+	{
+		if (!vReaders[i].Open(vInputs[i]) || (vReaders[i].GetChunkCount() != iChunks))
+			return false;
+	}
 
-	m_strInputFile = infile;
-	m_strOutputFile = outfile;
+	auto fnRead = [&](uint32_t iChunk)
+	{
+		if (!reader.ReadRawChunk(iChunk, vSlots[iChunk % vSlots.size()]._vRaw))
+		{
+			strReadError = reader.GetErrorMsg();
+			return false;
+		}
 
-	TIFF* pInfile = nullptr;
-	TIFF* pOutfile = nullptr;
+		return true;
+	};
+
+	auto fnJob = [&](unsigned iWorker, uint32_t iChunk)
+	{
+		CTiffStripReader& decoder = vReaders[iWorker];
+		ChunkSlot& slot = vSlots[iChunk % vSlots.size()];
+		if (!decoder.DecodeChunk(iChunk, slot._vRaw))
+			return false;
+
+		ChunkInfo& info = slot._info;
+		info = { iChunk, decoder.GetChunkX(), decoder.GetChunkY(), decoder.GetChunkWidth(), decoder.GetRowsInChunk(), decoder.GetRowBytesInChunk(), decoder.GetChunkSize() };
+		//the gray rows are made in the slot, the decoded chunk is copied there as the decoder moves on
+		unsigned char* pData = PrepareChunk(decoder, info, eOutput == GRAY_CHUNK, iRowSize, iOutPixelBits, slot._vData);
+
+		if (eOutput == ENCODED_CHUNK)
+			return EncodeChunk(format, info, pData, vScratch[iWorker], slot);
+
+		if (eOutput == DECODED_CHUNK)
+			slot._vData.assign(pData, pData + info._size);
+
+		return true;
+	};
+
+	auto fnCommit = [&](uint32_t iChunk)
+	{
+		ChunkSlot& slot = vSlots[iChunk % vSlots.size()];
+		if (eOutput != ENCODED_CHUNK)
+		{
+			if (!fnChunk(slot._info, slot._vData.data()))
+			{
+				m_strErrorMsg = "Error writing chunk " + std::to_string(iChunk) + "!!";
+				return false;
+			}
+
+			return true;
+		}
+
+		//the chunks of a page are encoded with the same JPEG tables, the page gets the ones of the first chunk
+		if (iChunk == 0)
+		{
+			vTables = slot._vTables;
+			if (!vTables.empty())
+				TIFFSetField(pOutfile, TIFFTAG_JPEGTABLES, (uint32)vTables.size(), vTables.data());
+		}
+		else if (slot._vTables != vTables)
+		{
+			m_strErrorMsg = "Chunk " + std::to_string(iChunk) + " has other JPEG tables than the page!!";
+			return false;
+		}
+
+		tmsize_t iSize = (tmsize_t)slot._vData.size();
+		tmsize_t iWritten = format._bTiled ? TIFFWriteRawTile(pOutfile, iChunk, slot._vData.data(), iSize)
+										   : TIFFWriteRawStrip(pOutfile, iChunk, slot._vData.data(), iSize);
+		if (iWritten != iSize)
+		{
+			m_strErrorMsg = "Error writing chunk " + std::to_string(iChunk) + "!!";
+			return false;
+		}
+
+		return true;
+	};
+
+	CTiffOrderedJobs jobs(iThreads, (uint32_t)vSlots.size());
+	bool bRes = jobs.Run(iChunks, fnRead, fnJob, fnCommit);
+
+	if (!bRes && (jobs.GetFailedJob() < iChunks))
+		m_strErrorMsg = strReadError.empty() ? "Error processing chunk " + std::to_string(jobs.GetFailedJob()) + "!!" : strReadError;
+
+	return bRes;
+}
+
+bool CTiffProvider::CopyPageTags(TIFF* pInfile, TIFF* pOutfile)
+{
+	uint16 iShort = 0, iShort2 = 0;
+	uint32 iLong = 0;
+	float fValue = 0;
+
+	//layout tags, the raw strips/tiles are only valid with the same geometry
+	TIFFSetField(pOutfile, TIFFTAG_IMAGEWIDTH, m_TagHeader._width);
+	TIFFSetField(pOutfile, TIFFTAG_IMAGELENGTH, m_TagHeader._height);
+	TIFFSetField(pOutfile, TIFFTAG_BITSPERSAMPLE, m_TagHeader._bitspersample);
+	TIFFSetField(pOutfile, TIFFTAG_SAMPLESPERPIXEL, m_TagHeader._samplesperpixel);
+	TIFFSetField(pOutfile, TIFFTAG_PLANARCONFIG, m_TagHeader._config);
+	TIFFSetField(pOutfile, TIFFTAG_PHOTOMETRIC, m_TagHeader._photometric);
+
+	if ((m_TagHeader._orientation >= ORIENTATION_TOPLEFT) && (m_TagHeader._orientation <= ORIENTATION_LEFTBOT))
+		TIFFSetField(pOutfile, TIFFTAG_ORIENTATION, m_TagHeader._orientation);
+
+	if (TIFFIsTiled(pInfile))
+	{
+		TIFFGetField(pInfile, TIFFTAG_TILEWIDTH, &iLong);
+		TIFFSetField(pOutfile, TIFFTAG_TILEWIDTH, iLong);
+		TIFFGetField(pInfile, TIFFTAG_TILELENGTH, &iLong);
+		TIFFSetField(pOutfile, TIFFTAG_TILELENGTH, iLong);
+	}
+	else
+	{
+		TIFFGetFieldDefaulted(pInfile, TIFFTAG_ROWSPERSTRIP, &iLong);
+		TIFFSetField(pOutfile, TIFFTAG_ROWSPERSTRIP, iLong);
+	}
+
+	//codec tags, setting the compression first creates the codec specific fields
+	if (!TIFFSetField(pOutfile, TIFFTAG_COMPRESSION, m_TagHeader._compression))
+		return false;
+
+	if (TIFFGetField(pInfile, TIFFTAG_FILLORDER, &iShort))
+		TIFFSetField(pOutfile, TIFFTAG_FILLORDER, iShort);
+	if (TIFFGetField(pInfile, TIFFTAG_PREDICTOR, &iShort))
+		TIFFSetField(pOutfile, TIFFTAG_PREDICTOR, iShort);
+	if (TIFFGetField(pInfile, TIFFTAG_SAMPLEFORMAT, &iShort))
+		TIFFSetField(pOutfile, TIFFTAG_SAMPLEFORMAT, iShort);
+	if (TIFFGetField(pInfile, TIFFTAG_GROUP3OPTIONS, &iLong))
+		TIFFSetField(pOutfile, TIFFTAG_GROUP3OPTIONS, iLong);
+	if (TIFFGetField(pInfile, TIFFTAG_GROUP4OPTIONS, &iLong))
+		TIFFSetField(pOutfile, TIFFTAG_GROUP4OPTIONS, iLong);
+
+	uint16 iCount = 0;
+	uint16* pExtraSamples = nullptr;
+	if (TIFFGetField(pInfile, TIFFTAG_EXTRASAMPLES, &iCount, &pExtraSamples))
+		TIFFSetField(pOutfile, TIFFTAG_EXTRASAMPLES, iCount, pExtraSamples);
+
+	uint16 *pRed = nullptr, *pGreen = nullptr, *pBlue = nullptr;
+	if (TIFFGetField(pInfile, TIFFTAG_COLORMAP, &pRed, &pGreen, &pBlue))
+		TIFFSetField(pOutfile, TIFFTAG_COLORMAP, pRed, pGreen, pBlue);
+
+	if (m_TagHeader._photometric == PHOTOMETRIC_YCBCR)
+	{
+		float* pRefBlackWhite = nullptr;
+		if (TIFFGetField(pInfile, TIFFTAG_YCBCRSUBSAMPLING, &iShort, &iShort2))
+			TIFFSetField(pOutfile, TIFFTAG_YCBCRSUBSAMPLING, iShort, iShort2);
+		if (TIFFGetField(pInfile, TIFFTAG_YCBCRPOSITIONING, &iShort))
+			TIFFSetField(pOutfile, TIFFTAG_YCBCRPOSITIONING, iShort);
+		if (TIFFGetField(pInfile, TIFFTAG_REFERENCEBLACKWHITE, &pRefBlackWhite))
+			TIFFSetField(pOutfile, TIFFTAG_REFERENCEBLACKWHITE, pRefBlackWhite);
+	}
+
+	//abbreviated JPEG strips can only be decoded with the tables of the source page.
+	//libtiff reserves an empty JPEGTABLES field for new files, drop it if the source has none
+	if (m_TagHeader._compression == COMPRESSION_JPEG)
+	{
+		uint32 iTablesSize = 0;
+		void* pTables = nullptr;
+		if (TIFFGetField(pInfile, TIFFTAG_JPEGTABLES, &iTablesSize, &pTables) && (iTablesSize > 0))
+			TIFFSetField(pOutfile, TIFFTAG_JPEGTABLES, iTablesSize, pTables);
+		else
+			TIFFUnsetField(pOutfile, TIFFTAG_JPEGTABLES);
+	}
+
+	//keep the scan resolution, viewers and printers depend on it
+	if (TIFFGetField(pInfile, TIFFTAG_XRESOLUTION, &fValue))
+		TIFFSetField(pOutfile, TIFFTAG_XRESOLUTION, fValue);
+	if (TIFFGetField(pInfile, TIFFTAG_YRESOLUTION, &fValue))
+		TIFFSetField(pOutfile, TIFFTAG_YRESOLUTION, fValue);
+	if (TIFFGetField(pInfile, TIFFTAG_RESOLUTIONUNIT, &iShort))
+		TIFFSetField(pOutfile, TIFFTAG_RESOLUTIONUNIT, iShort);
+
+	return true;
+}
+
+bool CTiffProvider::CopyRawData(TIFF* pInfile, TIFF* pOutfile)
+{
+	bool bRes = true;
+
+	if (!CopyPageTags(pInfile, pOutfile))
+	{
+		m_strErrorMsg = "Error copying the tag header info!!";
+		return false;
+	}
+
+	//move every strip(or tile) as is, the compressed bytes are never decoded
+	bool bTiled = (TIFFIsTiled(pInfile) != 0);
+	uint32 iChunks = bTiled ? TIFFNumberOfTiles(pInfile) : TIFFNumberOfStrips(pInfile);
+	uint64* pByteCounts = nullptr;
+
+	if (!TIFFGetField(pInfile, bTiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &pByteCounts))
+	{
+		m_strErrorMsg = "Error reading the strip byte counts!!";
+		return false;
+	}
+
+	std::vector<unsigned char> vRawData;
+
+	for (uint32 chunk = 0; chunk < iChunks; chunk++)
+	{
+		tmsize_t iSize = (tmsize_t)pByteCounts[chunk];
+		if (iSize == 0)
+			continue;
+
+		if ((tmsize_t)vRawData.size() < iSize)
+			vRawData.resize(iSize);
+
+		tmsize_t iRead = bTiled ? TIFFReadRawTile(pInfile, chunk, vRawData.data(), iSize)
+								: TIFFReadRawStrip(pInfile, chunk, vRawData.data(), iSize);
+		if (iRead < 0)
+		{
+			bRes = false;
+			break;
+		}
+
+		tmsize_t iWritten = bTiled ? TIFFWriteRawTile(pOutfile, chunk, vRawData.data(), iRead)
+								   : TIFFWriteRawStrip(pOutfile, chunk, vRawData.data(), iRead);
+		if (iWritten != iRead)
+		{
+			bRes = false;
+			break;
+		}
+	}
+
+	//close the page, the next page starts a new directory
+	if (!TIFFWriteDirectory(pOutfile))
+		bRes = false;
+
+	return bRes;
+}
+
+bool CTiffProvider::TranscodeToGray(TIFF* pInfile, TIFF* pOutfile)
+{
+	bool bRes = true;
+
+	CTiffJpegTranscoder transcoder;
+	if (!transcoder.Open(pInfile))
+	{
+		m_strErrorMsg = transcoder.GetErrorMsg();
+		return false;
+	}
+
+	//the gray page keeps the layout of the input, with one sample per pixel
+	TagHeader header = m_TagHeader;
+	m_TagHeader._samplesperpixel = 1;
+	m_TagHeader._photometric = PHOTOMETRIC_MINISBLACK;
+	bool bTags = CopyPageTags(pInfile, pOutfile);
+	m_TagHeader = header;
+
+	if (!bTags)
+	{
+		m_strErrorMsg = "Error copying the tag header info!!";
+		return false;
+	}
+
+	bool bTiled = (TIFFIsTiled(pInfile) != 0);
+	uint32 iChunks = bTiled ? TIFFNumberOfTiles(pInfile) : TIFFNumberOfStrips(pInfile);
+	std::vector<unsigned char> vGray;
+
+	for (uint32 chunk = 0; chunk < iChunks; chunk++)
+	{
+		if (!transcoder.ToGray(chunk, vGray))
+		{
+			m_strErrorMsg = transcoder.GetErrorMsg();
+			bRes = false;
+			break;
+		}
+
+		//the strips are abbreviated streams over the tables of the first one
+		if (chunk == 0)
+		{
+			const std::vector<unsigned char>& vTables = transcoder.GetTables();
+			TIFFSetField(pOutfile, TIFFTAG_JPEGTABLES, (uint32)vTables.size(), vTables.data());
+		}
+
+		tmsize_t iWritten = bTiled ? TIFFWriteRawTile(pOutfile, chunk, vGray.data(), (tmsize_t)vGray.size())
+								   : TIFFWriteRawStrip(pOutfile, chunk, vGray.data(), (tmsize_t)vGray.size());
+		if (iWritten != (tmsize_t)vGray.size())
+		{
+			bRes = false;
+			break;
+		}
+	}
+
+	//close the page, the next page starts a new directory
+	if (!TIFFWriteDirectory(pOutfile))
+		bRes = false;
+
+	return bRes;
+}
+
+void CTiffProvider::GetOutputLayout(TIFF* pOutfile, CTiffStripReader& reader, uint32_t& iRowsPerStrip, uint32_t& iTileWidth, uint32_t& iTileLength)
+{
+	std::string strLayout = m_Params._strLayout;
+
+	iRowsPerStrip = 0;
+	iTileWidth = 0;
+	iTileLength = 0;
+
+	if (strLayout == "auto")
+	{
+		//large pages are tiled for random access by viewers, bilevel pages stay in strips as
+		//G3/G4 restart the 2D coding in every tile and fax readers expect strips
+		uint16 iBitsPerSample = 1;
+		TIFFGetFieldDefaulted(pOutfile, TIFFTAG_BITSPERSAMPLE, &iBitsPerSample);
+
+		bool bLargePage = (m_TagHeader._width >= 2048) && (m_TagHeader._height >= 2048);
+		strLayout = (bLargePage && (iBitsPerSample > 1)) ? "tiles" : "strips";
+	}
+
+	if (strLayout == "tiles")
+	{
+		//tile sizes have to be multiples of 16
+		iTileWidth = std::max((uint32_t)16, (m_Params._iTileWidth + 15) & ~(uint32_t)15);
+		iTileLength = std::max((uint32_t)16, (m_Params._iTileLength + 15) & ~(uint32_t)15);
+		return;
+	}
+
+	if (strLayout == "strips")
+	{
+		//rows of the output page, converted pages have fewer bytes per row than the input
+		uint64_t iRowSize = std::max((uint64_t)1, (uint64_t)TIFFScanlineSize64(pOutfile));
+
+		iRowsPerStrip = m_Params._iRowsPerStrip;
+		if (iRowsPerStrip == 0)
+			iRowsPerStrip = (uint32_t)std::max((uint64_t)1, m_Params._iStripSize / iRowSize);
+
+		//JPEG strips are made of whole 16 row MCUs(8 without subsampling), except for a single strip page
+		uint16 iCompression = COMPRESSION_NONE;
+		TIFFGetFieldDefaulted(pOutfile, TIFFTAG_COMPRESSION, &iCompression);
+		if (iCompression == COMPRESSION_JPEG)
+			iRowsPerStrip = std::max((uint32_t)16, (iRowsPerStrip + 15) & ~(uint32_t)15);
+
+		iRowsPerStrip = std::min(iRowsPerStrip, std::max(m_TagHeader._height, (uint32_t)1));
+		return;
+	}
+
+	//"input" keeps the strips or tiles of the input page
+	if (reader.IsTiled())
+	{
+		iTileWidth = reader.GetChunkWidth();
+		iTileLength = reader.GetChunkLength();
+	}
+	else
+		iRowsPerStrip = reader.GetChunkLength();
+}
+
+bool CTiffProvider::IsPageType(TIFF* pFile, m_ePageType pType)
+{
+	bool bResult = true;
+	bool bColourPage = false;
+	int iSamplesPerPixel = m_TagHeader._samplesperpixel;
+
+	//blank check: stop decoding once the page has more ink than a blank page may have
+	if (pType == m_ePageType::BLANK)
+	{
+		//the strip byte counts settle most pages without decoding them
+		m_eSizeClass eSize = ClassifyBySize(pFile);
+		if (eSize != m_eSizeClass::AMBIGUOUS)
+			return (eSize == m_eSizeClass::BLANK_BY_SIZE);
+
+		//JPEG pages are entropy decoded only, as long as the coefficients settle it
+		CTiffJpegAnalyzer::m_eVerdict eVerdict = CheckJpegPage(pFile, pType);
+		if (eVerdict != CTiffJpegAnalyzer::UNDECIDED)
+			return (eVerdict == CTiffJpegAnalyzer::YES);
+
+		uint64_t iInk = 0, iSamples = 0;
+		if (!MeasureInk(pFile, true, iInk, iSamples))
+			return false;
+
+		return (iInk <= GetMaxInk(iSamples));
+	}
+
+	//For RGB/Grayscale with 3 samples per pixel.
+	/*if (!ValidPixelFormat())
+		return false;*/
+
+	CTiffJpegAnalyzer::m_eVerdict eVerdict = CheckJpegPage(pFile, pType);
+	if (eVerdict != CTiffJpegAnalyzer::UNDECIDED)
+		return (eVerdict == CTiffJpegAnalyzer::YES);
+
+	CTiffStripReader reader;
+	if (!reader.Open(pFile))
+		return false;
+
+	//scan the page a strip(or tile) at a time, row by row inside of it
+	for (uint32_t chunk = 0; (chunk < reader.GetChunkCount()) && (bResult && !bColourPage); chunk++)
+	{
+		if (!reader.ReadChunk(chunk))
+			return false;
+
+		tmsize_t lineSize = reader.GetRowBytesInChunk();
+
+		for (uint32_t row = 0; (row < reader.GetRowsInChunk()) && (bResult && !bColourPage); row++)
+		{
+			unsigned char* sourceImage = reader.GetChunkRow(row);
+
+			//Check for page type (GRAYSCAL, COLOUR)
+			for (int index = 0; index < lineSize; index += iSamplesPerPixel)
+			{
+				if ((pType == m_ePageType::COLOUR) || (pType == m_ePageType::GRAYSCALE))
+				{
+					//if samples per pixel == 3, RGB values should not be same
+					unsigned char ch = sourceImage[index];
+					unsigned char ch1 = sourceImage[index + 1];
+					unsigned char ch2 = sourceImage[index + 2];
+					if((ch | ch1 | ch2) != (ch & ch1 & ch2 ))
+					{
+						bColourPage = true;
+						break;
+					}
+				}
+				//else if (pType == m_ePageType::BINARY)
+				//{
+				//	if ((sourceImage[index] != 0xFF) && (sourceImage[index] != 0x00))
+				//	{
+				//		bResult = false;
+				//		//break;
+				//	}
+				//}
+
+				if (!bResult)
+					break;
+			}
+		}
+	}
+
+	//if not colour page, it is a grayscale
+	if (pType == m_ePageType::GRAYSCALE)
+		return !bColourPage;
+	if (pType == m_ePageType::COLOUR)
+		return bColourPage;
+
+	return bResult;
+}
+
+CTiffProvider::m_eSizeClass CTiffProvider::ClassifyBySize(TIFF* pFile)
+{
+	if (m_Params._strBlankPrefilter == "off")
+		return m_eSizeClass::AMBIGUOUS;
+
+	const SizeLimits* pLimits = nullptr;
+	for (auto& limits : BLANK_SIZE_LIMITS)
+	{
+		if (limits._compression == m_TagHeader._compression)
+			pLimits = &limits;
+	}
+
+	//uncompressed pages or pages of unknown codecs say nothing with their size
+	uint64_t iDecodedSize = ((uint64_t)m_TagHeader._width * m_TagHeader._height * m_TagHeader._samplesperpixel * m_TagHeader._bitspersample) / 8;
+	if (!pLimits || (iDecodedSize == 0))
+		return m_eSizeClass::AMBIGUOUS;
+
+	uint64* pByteCounts = nullptr;
+	uint64_t iSize = 0;
+	bool bTiled = (TIFFIsTiled(pFile) != 0);
+	uint32_t iChunks = bTiled ? TIFFNumberOfTiles(pFile) : TIFFNumberOfStrips(pFile);
+
+	if (!TIFFGetField(pFile, bTiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &pByteCounts) || !pByteCounts)
+		return m_eSizeClass::AMBIGUOUS;
+
+	for (uint32_t chunk = 0; chunk < iChunks; chunk++)
+		iSize += pByteCounts[chunk];
+
+	double dRatio = (double)iSize / iDecodedSize;
+
+	//the limits are for pages that must be clean white, a noisy scan within the tolerance(or the ink allowed)
+	//compresses as badly as a page with ink, so its pixels have to be looked at
+	bool bStrictWhite = (m_Params._iBlankTolerance == 0) && (m_Params._dBlankMaxInk <= 0);
+	if (bStrictWhite && (dRatio > pLimits->_dInk))
+		return m_eSizeClass::INK_BY_SIZE;
+
+	//a small mark hardly changes the size of a page, so small pages are only taken as blank on request
+	if ((m_Params._strBlankPrefilter == "all") && (dRatio < pLimits->_dBlank))
+		return m_eSizeClass::BLANK_BY_SIZE;
+
+	return m_eSizeClass::AMBIGUOUS;
+}
+
+bool CTiffProvider::MeasureInk(TIFF* pFile, bool bStopEarly, uint64_t& iInk, uint64_t& iSamples)
+{
+	iInk = 0;
+	iSamples = GetInkSamples();
+
+	CTiffStripReader reader;
+	if (!reader.Open(pFile))
+		return false;
+
+	uint64_t iStopAfter = bStopEarly ? GetMaxInk(iSamples) : UINT64_MAX;
+	uint32_t iProbeRows = (bStopEarly && !reader.IsTiled() && (reader.GetChunkLength() >= BLANK_PROBE_ROWS)) ? reader.GetChunkLength() / 8 : 0;
+
+	for (uint32_t chunk = 0; chunk < reader.GetChunkCount(); chunk++)
+	{
+		//most pages have ink near the top, so a large strip is only partly decoded first
+		if (iProbeRows > 0)
+		{
+			if (!reader.ReadChunk(chunk, iProbeRows))
+				return false;
+
+			iInk += CountInkInChunk(reader, 0, iStopAfter - iInk);
+			if (iInk > iStopAfter)
+				return true;
+		}
+
+		//when the whole strip has been probed, the rows are not looked at again
+		uint32_t iFirstRow = reader.GetRowsInChunk();
+		if (iProbeRows == 0)
+			iFirstRow = 0;
+		else if (iFirstRow < iProbeRows)
+			continue;
+
+		if (!reader.ReadChunk(chunk))
+			return false;
+
+		iInk += CountInkInChunk(reader, iFirstRow, iStopAfter - iInk);
+		if (iInk > iStopAfter)
+			return true;
+	}
+
+	return true;
+}
+
+uint64_t CTiffProvider::CountInkInChunk(CTiffStripReader& reader, uint32_t iFirstRow, uint64_t iStopAfter)
+{
+	uint32_t iLeft, iTop, iRight, iBottom;
+	int iBits = m_TagHeader._bitspersample;
+	uint64_t iPixelBits = (uint64_t)iBits * m_TagHeader._samplesperpixel;
+
+	//usually white pixels have value 0xFF(255)
+	unsigned char iWhitePixel = (m_TagHeader._photometric == PHOTOMETRIC_MINISWHITE) ? 0x00 : 0xFF;
+
+	//alpha samples are skipped for 8 bit pages, other depths compare every byte
+	int iSamplesPerPixel = (iBits == 8) ? m_TagHeader._samplesperpixel : 1;
+
+	//the part of the chunk inside of the margins
+	GetInkRegion(iLeft, iTop, iRight, iBottom);
+	uint32_t iChunkX = reader.GetChunkX(), iChunkY = reader.GetChunkY();
+
+	uint32_t iFromRow = std::max(iFirstRow, (iTop > iChunkY) ? iTop - iChunkY : 0);
+	uint32_t iToRow = std::min(reader.GetRowsInChunk(), (iBottom > iChunkY) ? iBottom - iChunkY : 0);
+	uint32_t iFromX = std::max(iLeft, iChunkX);
+	uint32_t iToX = std::min(iRight, iChunkX + reader.GetChunkWidth());
+
+	if ((iFromRow >= iToRow) || (iFromX >= iToX))
+		return 0;
+
+	//the byte of a partly covered last pixel byte(1 bit pages) holds row padding, it is left out
+	tmsize_t iFrom = (tmsize_t)(((iFromX - iChunkX) * iPixelBits + 7) / 8);
+	tmsize_t iTo = std::min(reader.GetRowBytesInChunk(), (tmsize_t)(((iToX - iChunkX) * iPixelBits) / 8));
+
+	if (iFrom >= iTo)
+		return 0;
+
+	auto countInk = [&](const unsigned char* pData, size_t iBytes, uint64_t iStop) -> uint64_t
+	{
+		if (iBits == 1)
+			return CTiffPixelKernels::CountInkBits(pData, iBytes, iWhitePixel);
+
+		//no ink allowed at all: the first ink ends the check
+		if ((m_Params._iBlankTolerance == 0) && (iStop == 0))
+			return CTiffPixelKernels::IsBlank(pData, iBytes, iWhitePixel, iSamplesPerPixel) ? 0 : 1;
+
+		return CTiffPixelKernels::CountInk(pData, iBytes, iWhitePixel, m_Params._iBlankTolerance, iSamplesPerPixel, iStop);
+	};
+
+	//without side margins the rows of a strip are one block of memory
+	if (!reader.IsTiled() && (iFrom == 0) && (iTo == reader.GetRowSize()))
+		return countInk(reader.GetChunkRow(iFromRow), (size_t)(iToRow - iFromRow) * reader.GetRowSize(), iStopAfter);
+
+	//edge tiles hold padding after the pixels of each row
+	uint64_t iInk = 0;
+	for (uint32_t row = iFromRow; (row < iToRow) && (iInk <= iStopAfter); row++)
+		iInk += countInk(reader.GetChunkRow(row) + iFrom, (size_t)(iTo - iFrom), iStopAfter - iInk);
+
+	return iInk;
+}
+
+uint64_t CTiffProvider::GetInkSamples()
+{
+	uint32_t iLeft, iTop, iRight, iBottom;
+	int iBits = m_TagHeader._bitspersample;
+	int iSamplesPerPixel = m_TagHeader._samplesperpixel;
+
+	//ink is counted in 8 bit colour samples(alpha is not counted), in 1 bit pixels or in bytes for other depths
+	GetInkRegion(iLeft, iTop, iRight, iBottom);
+	uint64_t iWidth = iRight - iLeft, iHeight = iBottom - iTop;
+
+	if (iBits == 8)
+		return iWidth * iHeight * (((iSamplesPerPixel == 2) || (iSamplesPerPixel == 4)) ? iSamplesPerPixel - 1 : iSamplesPerPixel);
+	if (iBits == 1)
+		return iWidth * iHeight;
+
+	return ((iWidth * iBits * iSamplesPerPixel) / 8) * iHeight;
+}
+
+CTiffJpegAnalyzer::m_eVerdict CTiffProvider::CheckJpegPage(TIFF* pFile, m_ePageType pType)
+{
+	CTiffJpegAnalyzer::m_eVerdict eResult = CTiffJpegAnalyzer::UNDECIDED;
+
+	if (!m_Params._bDctAnalysis || (m_TagHeader._compression != COMPRESSION_JPEG))
+		return eResult;
+
+	//pages the analyzer cant read are left to the pixel checks
+	CTiffJpegAnalyzer analyzer;
+	if (!analyzer.Open(pFile))
+		return eResult;
+
+	if (pType == m_ePageType::BLANK)
+	{
+		uint32_t iLeft, iTop, iRight, iBottom;
+		GetInkRegion(iLeft, iTop, iRight, iBottom);
+
+		if (!analyzer.CheckBlank(m_Params._iBlankTolerance, GetMaxInk(GetInkSamples()), iLeft, iTop, iRight, iBottom, eResult))
+			return CTiffJpegAnalyzer::UNDECIDED;
+	}
+	else if ((pType == m_ePageType::GRAYSCALE) || (pType == m_ePageType::COLOUR))
+	{
+		if (!analyzer.CheckGray(eResult))
+			return CTiffJpegAnalyzer::UNDECIDED;
+
+		//a page that isnt gray for sure is colour for sure
+		if ((pType == m_ePageType::COLOUR) && (eResult != CTiffJpegAnalyzer::UNDECIDED))
+			eResult = (eResult == CTiffJpegAnalyzer::YES) ? CTiffJpegAnalyzer::NO : CTiffJpegAnalyzer::YES;
+	}
+
+	return eResult;
+}
+
+void CTiffProvider::GetInkRegion(uint32_t& iLeft, uint32_t& iTop, uint32_t& iRight, uint32_t& iBottom)
+{
+	//the margins are a percentage of the page size, at most just under half of it
+	uint16_t iMargin = std::min(m_Params._iBlankMargin, (uint16_t)49);
+
+	iLeft = (uint32_t)(((uint64_t)m_TagHeader._width * iMargin) / 100);
+	iTop = (uint32_t)(((uint64_t)m_TagHeader._height * iMargin) / 100);
+	iRight = m_TagHeader._width - iLeft;
+	iBottom = m_TagHeader._height - iTop;
+}
+
+uint64_t CTiffProvider::GetMaxInk(uint64_t iSamples)
+{
+	double dMaxInk = std::min(std::max(m_Params._dBlankMaxInk, 0.0), 100.0);
+	return (uint64_t)(iSamples * dMaxInk / 100.0);
+}
+
+bool CTiffProvider::ValidPixelFormat()
+{
+	//PALETTE type photometric and one channel data are not supported for color converstions
+	if ((m_TagHeader._photometric != PHOTOMETRIC_PALETTE) && (m_TagHeader._samplesperpixel == 3) || (m_TagHeader._samplesperpixel == 4))
+		return true;
+
+	return false;
+}
+
+bool CTiffProvider::ToGrayScale(const unsigned char* pSourceImage, unsigned char* pGrayImage, uint32_t lineSize, int iSamplesperpixel, int iGraySamples, bool bToBinary, int iThreshold)
+{
+	//the kernel works on whole rows with fixed point weights, gray pixels keep their value.
+	//the gray is packed straight into the output row, which may be the source row.
+	//binary rows are packed again into bits, gray above the threshold is white
+	size_t iPixels = lineSize / iSamplesperpixel;
+
+	if (bToBinary)
+	{
+		CTiffPixelKernels::ToGrayPacked(pSourceImage, pGrayImage, iPixels, iSamplesperpixel, 1);
+		CTiffPixelKernels::PackBits(pGrayImage, pGrayImage, iPixels, iThreshold);
+	}
+	else
+		CTiffPixelKernels::ToGrayPacked(pSourceImage, pGrayImage, iPixels, iSamplesperpixel, iGraySamples);
+
+	return true;
+}
+
+int CTiffProvider::GetGraySamples()
+{
+	//the 4th sample of 4 sample pages is taken as alpha, binary pages have none
+	return ((m_TagHeader._samplesperpixel == 4) && m_Params._bKeepAlpha && !m_bToBinary) ? 2 : 1;
+}
+
+bool CTiffProvider::FindBlankPages(std::string& infile, std::set<uint16_t>& pNumbers)
+{
+	TIFF* pInfile = OpenInputFile(infile);
+
+	if (!pInfile)
+	{
+		m_strErrorMsg = "Error opening input file: " + infile;
+		return false;
+	}
+
+	uint16_t iPageCount = GetPageCount(pInfile);
+	unsigned iThreads = GetThreads(iPageCount);
+
+	if (iThreads > 1)
+	{
+		auto fnPage = [](CTiffProvider& worker, TIFF* pFile, uint16_t pno, PageOutput& page)
+		{
+			if (worker.m_PageIndex.SetPage(pno))
+			{
+				worker.GetTagInfo(pFile);
+				page._bBlank = worker.IsPageType(pFile, m_ePageType::BLANK);
+			}
+			return true;
+		};
+
+		auto fnCommit = [&](uint16_t pno, PageOutput& page)
+		{
+			if (page._bBlank)
+				pNumbers.emplace(pno + 1);
+			return true;
+		};
+
+		bool bRes = RunPages(pInfile, iPageCount, iThreads, fnPage, fnCommit);
+		TIFFClose(pInfile);
+		return bRes;
+	}
+
+	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+	{
+		if (m_PageIndex.SetPage(pageno))
+		{
+			GetTagInfo(pInfile);
+
+			if (IsPageType(pInfile, m_ePageType::BLANK))
+				pNumbers.emplace(pageno + 1);
+		}
+	}
+
+	TIFFClose(pInfile);
+	return true;
+}
+
+bool CTiffProvider::RemovePagesFromChain(std::set<uint32_t>& pages, bool& bTryDecode)
+{
+	CTiffIFDChain ifdChain;
+	bool bInPlace = (m_Params._strRemoveMode == "inplace") && m_strOutputFile.empty();
+	bTryDecode = true;
+
+	if (!ifdChain.Open(m_strInputFile, bInPlace))
+	{
+		m_strErrorMsg = ifdChain.GetErrorMsg();
+		return false;
+	}
+
+	//inplace: only the next-IFD pointers around the removed pages are rewritten
+	if (bInPlace)
+	{
+		//a chain that couldnt be put back is not decoded again, the pages it lost would be missing
+		if (!ifdChain.UnlinkPages(pages))
+		{
+			m_strErrorMsg = ifdChain.GetErrorMsg();
+			bTryDecode = !ifdChain.IsDamaged();
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<uint32_t> vPages;
+	for (uint32_t pno = 0; pno < ifdChain.GetPageCount(); pno++)
+	{
+		if (pages.find(pno) == pages.end())
+			vPages.push_back(pno);
+	}
+
+	//nothing to remove and no new file requested
+	if ((vPages.size() == ifdChain.GetPageCount()) && m_strOutputFile.empty())
+		return true;
+
+	std::string strOutfile = m_strOutputFile.empty() ? GetTempFile(m_strInputFile) : m_strOutputFile;
+
+	bool bRes = ifdChain.CopyPages(vPages, strOutfile);
+	ifdChain.Close();
+
+	if (!bRes)
+	{
+		m_strErrorMsg = ifdChain.GetErrorMsg();
+		std::remove(strOutfile.c_str());
+		return false;
+	}
+
+	if (m_strOutputFile.empty())
+	{
+		std::remove(m_strInputFile.c_str());
+		std::rename(strOutfile.c_str(), m_strInputFile.c_str());
+	}
+
+	return true;
+}
+
+bool CTiffProvider::ProcessMerge(TIFF* pInfile, TIFF* pOutfile)
+{
+	bool bRes = true;
+
+	//get the number of pages in the input TIFF file
+	uint16_t iPageCount = GetPageCount(pInfile);
+
+	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+	{
+		if (m_PageIndex.SetPage(pageno))
+		{
+			GetTagInfo(pInfile);
+
+			if (!WriteData(pInfile, pOutfile))
+			{
+				m_strErrorMsg = "Error writing the data to destination!!";
+				bRes = false;
+				break;
+			}
+		}
+	}
+
+	return bRes;
+}
+
+bool CTiffProvider::ProcessRemoveBlankPages(TIFF* pInfile, TIFF* pOutfile)
+{
+	return ProcessPages(pInfile, pOutfile, m_ePageOperation::REMOVE_BLANK);
+}
+
+bool CTiffProvider::ProcessRemovePageByNumber(TIFF* pInfile, TIFF* pOutfile, std::set<uint16_t>& pNumbers)
+{
+	bool bRes = true;
+
+	uint16_t iPageCount = GetPageCount(pInfile);
+	
+	for (uint16_t pno = 0; pno < iPageCount; pno++)
+	{
+		if (m_PageIndex.SetPage(pno))
+		{
+			//remove the page if its page no. matches with the page to be removed
+			if (pNumbers.find(pno + 1) != pNumbers.end())
+				continue;
+
+			//get the tagheader info from the input file
+			GetTagInfo(pInfile);
+
+			if (!WriteData(pInfile, pOutfile))
+			{
+				m_strErrorMsg = "Error: Failed to write the data to destination.";
+				bRes = false;
+				break;
+			}
+		}
+	}
+
+	return bRes;
+}
+
+void CTiffProvider::ProcessFileInfo(TIFF* pInfile, std::string& fileinfo)
+{
+	uint16_t iBlankpageCount = 0;
+	uint16_t iTotalPages = 0;
+	std::string strTagInfo = "";
+
+	iTotalPages = GetPageCount(pInfile);
+
+	for (uint16_t pageno = 0; pageno < iTotalPages; pageno++)
+	{
+		if (m_PageIndex.SetPage(pageno))
+		{
+			//get the tagheader info from the input file
+			GetTagInfo(pInfile);
+
+			//count all the ink of the page, it is reported with the page info.
+			//pages settled by their compressed size are not decoded
+			uint64_t iInk = 0, iSamples = 0;
+			m_eSizeClass eSize = ClassifyBySize(pInfile);
+			bool bMeasured = (eSize == m_eSizeClass::AMBIGUOUS) && MeasureInk(pInfile, false, iInk, iSamples);
+			double dCoverage = (iSamples > 0) ? (100.0 * iInk) / iSamples : 0.0;
+
+			//Is the current page BLANK? If yes, dont process it.
+			if ((eSize == m_eSizeClass::BLANK_BY_SIZE) || (bMeasured && (iInk <= GetMaxInk(iSamples))))
+				iBlankpageCount++;
+
+			std::string strCoverage = bMeasured ? std::to_string(dCoverage) + "%" : std::string("n/a");
+			if (eSize == m_eSizeClass::BLANK_BY_SIZE)
+				strCoverage = "n/a(blank by size)";
+			else if (eSize == m_eSizeClass::INK_BY_SIZE)
+				strCoverage = "n/a(ink by size)";
+
+			strTagInfo.append(("Page Number: " + std::to_string(pageno+1) += "\n"));
+			strTagInfo.append("---------------\n");
+			strTagInfo.append(("Width = " + std::to_string(m_TagHeader._width) + "\n"));
+			strTagInfo.append(("Height = " + std::to_string(m_TagHeader._height) + "\n"));
+			strTagInfo.append(("Layout(CONFIG) = " + std::to_string(m_TagHeader._config) + "\n"));
+			strTagInfo.append(("Phtometric = " + std::to_string(m_TagHeader._photometric) + "\n"));
+			strTagInfo.append(("Orientation = " + std::to_string(m_TagHeader._orientation) + "\n"));
+			strTagInfo.append(("Compression = " + std::to_string(m_TagHeader._compression) + "\n"));
+			strTagInfo.append(("Bits Per Sample = " + std::to_string(m_TagHeader._bitspersample) + "\n"));
+			strTagInfo.append(("Samples Per Pixel = " + std::to_string(m_TagHeader._samplesperpixel) + "\n"));
+			strTagInfo.append(("Ink Coverage = " + strCoverage + "\n\n"));
+		}
+	}
+
+	fileinfo.append(("Total number of pages: " + std::to_string(iTotalPages) + "\n"));
+	fileinfo.append(("Total number of Blank pages: " + std::to_string(iBlankpageCount) + "\n\n"));
+	fileinfo.append(strTagInfo);
+}
+
+bool CTiffProvider::ProcessConvertPageTo(TIFF* pInfile, TIFF* pOutfile, m_eConvertCode ccode)
+{
+	return ProcessPages(pInfile, pOutfile, (ccode == m_eConvertCode::TOGRAY) ? m_ePageOperation::CONVERT_TOGRAY : m_ePageOperation::CONVERT_TOBINARY);
+}
+
+bool CTiffProvider::ProcessPage(TIFF* pInfile, TIFF* pOutfile, uint16_t pno, m_ePageOperation op, bool& bWritten)
+{
+	bool bRes = true;
+	bool bTranscode = false;
+
+	bWritten = false;
+	if (!m_PageIndex.SetPage(pno))
+		return true;
+
+	//get the tagheader info from the input file
+	GetTagInfo(pInfile);
+
+	if (op == m_ePageOperation::REMOVE_BLANK)
+	{
+		//Is the current page BLANK? If yes, dont process it.
+		if (IsPageType(pInfile, m_ePageType::BLANK))
+			return true;
+
+		if (!WriteData(pInfile, pOutfile))
+		{
+			m_strErrorMsg = "Error writing the data to destination!!";
+			return false;
+		}
+
+		bWritten = true;
+		return true;
+	}
+
+	m_eConvertCode ccode = (op == m_ePageOperation::CONVERT_TOGRAY) ? m_eConvertCode::TOGRAY : m_eConvertCode::TOBINARY;
+
+	//if the input file is not a BLANK page, and has valid pixel format, then proceed for conversion.
+	//YCbCr JPEG pages become gray in the coefficient domain. pages with one sample are gray already,
+	//they fail ValidPixelFormat and are copied as they are, no pixel scan is needed to tell
+	if (!IsPageType(pInfile, m_ePageType::BLANK) && ValidPixelFormat())
+	{
+		if ((ccode == m_eConvertCode::TOGRAY) && m_Params._bGrayTranscode &&
+			(m_TagHeader._compression == COMPRESSION_JPEG) && (m_TagHeader._photometric == PHOTOMETRIC_YCBCR))
+			bTranscode = true;
+		else
+		{
+			m_bToGrayScale = (ccode == m_eConvertCode::TOGRAY) ? true : false;
+			m_bToBinary = (ccode == m_eConvertCode::TOBINARY) ? true : false;
+		}
+	}
+
+	bRes = bTranscode ? TranscodeToGray(pInfile, pOutfile) : WriteData(pInfile, pOutfile);
+
+	m_bToGrayScale = false;
+	m_bToBinary = false;
+
+	if (!bRes)
+	{
+		m_strErrorMsg = "Error: Failed to write the data to destination.";
+		return false;
+	}
+
+	TIFFFlush(pOutfile);
+	bWritten = true;
+	return true;
+}
+
+bool CTiffProvider::ProcessPages(TIFF* pInfile, TIFF* pOutfile, m_ePageOperation op)
+{
+	bool bWritten = false;
+	uint16_t iPageCount = GetPageCount(pInfile);
+	unsigned iThreads = GetThreads(iPageCount);
+
+	if (iThreads > 1)
+	{
+		//the workers write each page to a single page TIFF in memory,
+		//its strips are then copied raw to the output in page order
+		auto fnPage = [op](CTiffProvider& worker, TIFF* pFile, uint16_t pno, PageOutput& page)
+		{
+			TIFF* pPageFile = CTiffMemoryStream::OpenWrite(page._vData, "w");
+			if (!pPageFile)
+			{
+				worker.m_strErrorMsg = "Error creating output buffer!!";
+				return false;
+			}
+
+			bool bRes = worker.ProcessPage(pFile, pPageFile, pno, op, page._bWritten);
+			TIFFClose(pPageFile);
+			return bRes;
+		};
+
+		auto fnCommit = [&](uint16_t pno, PageOutput& page)
+		{
+			if (!page._bWritten)
+				return true;
+
+			TIFF* pPageFile = CTiffMemoryStream::OpenRead(page._vData.data(), page._vData.size());
+			if (!pPageFile)
+			{
+				m_strErrorMsg = "Error reading page " + std::to_string(pno + 1) + " from its buffer!!";
+				return false;
+			}
+
+			GetTagInfo(pPageFile);
+			bool bRes = CopyRawData(pPageFile, pOutfile);
+			TIFFClose(pPageFile);
+
+			if (!bRes)
+				m_strErrorMsg = "Error writing the data to destination!!";
+
+			return bRes;
+		};
+
+		return RunPages(pInfile, iPageCount, iThreads, fnPage, fnCommit);
+	}
+
+	for (uint16_t pno = 0; pno < iPageCount; pno++)
+	{
+		if (!ProcessPage(pInfile, pOutfile, pno, op, bWritten))
+			return false;
+	}
+
+	return true;
+}
+
+TIFF* CTiffProvider::OpenWorkerInput(TIFF* pInfile, CTiffMappedFile::m_eAccessHint eHint)
+{
+	//every worker reads the input through its own handle, libtiff handles cant be shared between threads
+	if (CTiffMemoryStream::IsMemoryStream(pInfile))
+		return CTiffMemoryStream::Reopen(pInfile);
+
+	return OpenInputFile(TIFFFileName(pInfile), eHint);
+}
+
+bool CTiffProvider::OpenChunkInputs(TIFF* pInfile, unsigned iCount, std::vector<TIFF*>& vInputs)
+{
+	//the handles are put on the page of pInfile
+	uint64 iPageOffset = TIFFCurrentDirOffset(pInfile);
+
+	for (unsigned i = 0; i < iCount; i++)
+	{
+		TIFF* pFile = OpenWorkerInput(pInfile);
+		if (pFile)
+			vInputs.push_back(pFile);
+
+		if (!pFile || !TIFFSetSubDirectory(pFile, iPageOffset))
+		{
+			for (TIFF* pInput : vInputs)
+				TIFFClose(pInput);
+
+			vInputs.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned CTiffProvider::GetThreads(uint32_t iJobs)
+{
+	unsigned iThreads = m_Params._iThreads ? m_Params._iThreads : std::max(1u, std::thread::hardware_concurrency());
+	return std::max(1u, std::min<unsigned>(iThreads, iJobs));
+}
+
+bool CTiffProvider::RunPages(TIFF* pInfile, uint16_t iPageCount, unsigned iThreads, const PageFunction& fnPage, const CommitFunction& fnCommit)
+{
+	//a worker has its own tag header, convert flags, page index and input handle.
+	//the threads left over by the pages are shared out to the workers for the chunks of their pages
+	TIFFParams params = m_Params;
+	params._iThreads = (uint16_t)std::max(1u, GetThreads(UINT32_MAX) / iThreads);
+
+	std::vector<std::unique_ptr<CTiffProvider>> vWorkers(iThreads);
+	std::vector<TIFF*> vInputs(iThreads, nullptr);
+	std::vector<PageOutput> vPages(iPageCount);
+
+	auto fnJob = [&](unsigned iWorker, uint32_t pno)
+	{
+		PageOutput& page = vPages[pno];
+
+		if (!vWorkers[iWorker])
+		{
+			vWorkers[iWorker].reset(new CTiffProvider(params));
+			//a worker gets every n-th page, so its handle jumps over the pages of the others
+			vInputs[iWorker] = OpenWorkerInput(pInfile, CTiffMappedFile::RANDOM);
+			if (vInputs[iWorker])
+				vWorkers[iWorker]->GetPageCount(vInputs[iWorker]);
+		}
+
+		CTiffProvider& worker = *vWorkers[iWorker];
+		if (!vInputs[iWorker] || (worker.m_PageIndex.GetPageCount() != iPageCount))
+		{
+			page._strError = "Error opening the input for page " + std::to_string(pno + 1) + "!!";
+			return false;
+		}
 
-	if (!OpenIOFiles(&pInfile, &pOutfile))
-		return false;
+		if (!fnPage(worker, vInputs[iWorker], (uint16_t)pno, page))
+		{
+			page._strError = worker.GetErrorMsg();
+			if (page._strError.empty())
+				page._strError = "Error processing page " + std::to_string(pno + 1) + "!!";
+			return false;
+		}
 
-	uint16_t iPageCount = GetPageCount(pInfile);
-	
-	for (uint16_t pno = 0; pno < iPageCount; pno++)
+		return true;
+	};
+
+	auto fnCommitPage = [&](uint32_t pno)
+	{
+		bool bRes = fnCommit((uint16_t)pno, vPages[pno]);
+		std::vector<unsigned char>().swap(vPages[pno]._vData);
+		return bRes;
+	};
+
+	CTiffOrderedJobs jobs(iThreads, iThreads * PAGE_LOOKAHEAD);
+	bool bRes = jobs.Run(iPageCount, fnJob, fnCommitPage);
+
+	if (!bRes && (jobs.GetFailedJob() < iPageCount))
+		m_strErrorMsg = vPages[jobs.GetFailedJob()]._strError;
+
+	for (TIFF* pInput : vInputs)
 	{
-		if (TIFFSetDirectory(pInfile, pno))
+		if (pInput)
+			TIFFClose(pInput);
+	}
+
+	return bRes;
+}
+
+//PUBLIC MEMBERS
+bool CTiffProvider::MergeFiles(std::string& infile1, std::string& infile2)
+{
+	std::vector<std::string> vInfiles = { infile2 };
+	return MergeFiles(infile1, vInfiles);
+}
+
+bool CTiffProvider::MergeFiles(std::string& infile1, std::vector<std::string>& vInfiles)
+{
+	bool bRes = true;
+
+	//a classic infile1 that would pass 4GB is rewritten as BigTIFF instead of being extended
+	CTiffIFDChain ifdChain;
+	bool bChainOpen = ifdChain.Open(infile1, true);
+
+	if (bChainOpen && !ifdChain.IsBigTIFF() && (m_Params._strBigTIFF != "never"))
+	{
+		uint64_t iAppendedSize = EstimateOutputSize(vInfiles);
+		uint64_t iExistingSize = 0;
+
+		if (ifdChain.GetFileSize(iExistingSize) && UseBigTIFF(iExistingSize + iAppendedSize))
 		{
-			//remove the page if its page no. matches with the page to be removed
-			if (pNumbers.find(pno + 1) != pNumbers.end())
-				continue;
+			ifdChain.Close();
+			return MergeToBigTIFF(infile1, vInfiles, iAppendedSize);
+		}
+	}
 
-			//get the tagheader info from the input file
-			GetTagInfo(pInfile);
+	//append the strip bytes and directories of all the files to infile1 in one pass,
+	//the cost is the bytes appended, no page is decoded and infile1 is scanned only once
+	if (bChainOpen && (m_Params._strMergeMode != "decode") && ifdChain.AppendFiles(vInfiles))
+		return true;
 
-			if (!WriteData(pInfile, pOutfile))
-			{
-				m_strErrorMsg = "Error: Failed to write the data to destination.";
-				bRes = false;
-				break;
-			}
+	//the end of infile1 as it is now, a failed merge below is cut back to it
+	uint64_t iOriginalSize = 0, iChainEnd = ifdChain.GetChainEnd();
+	bool bCanCutBack = bChainOpen && ifdChain.GetFileSize(iOriginalSize);
+	ifdChain.Close();
+
+	for (auto& infile2 : vInfiles)
+	{
+		m_strInputFile = infile2;
+		m_strOutputFile = infile1;
+
+		TIFF* pInfile1 = nullptr;
+		TIFF* pInfile2 = nullptr;
+
+		//we do "inplace merging here". we merge the two files by adding the contents of infile2 to infile1
+		if (!OpenIOFiles(&pInfile2, &pInfile1, false))
+		{
+			bRes = false;
+			break;
 		}
+
+		bRes = ProcessMerge(pInfile2, pInfile1);
+
+		CloseIOFiles(&pInfile2, &pInfile1, bRes);
+
+		if (!bRes)
+			break;
 	}
 
-	CloseIOFiles(&pInfile, &pOutfile);
+	//the pages merged before the failure are taken out again, same as AppendFiles does
+	if (!bRes && bCanCutBack && !ifdChain.CutBack(infile1, iOriginalSize, iChainEnd))
+		m_strErrorMsg += " " + ifdChain.GetErrorMsg();
+
 	return bRes;
 }
 
-//Miscellaneous operations
-bool CTiffProvider::GetFileInfo(std::string& infile, std::string& fileinfo, std::string outfile)
+bool CTiffProvider::RemoveBlankPages(std::string& infile, std::string outfile)
 {
 	bool bRes = true;
-	uint16_t iBlankpageCount = 0;
-	uint16_t iTotalPages = 0;
-	std::string strTagInfo = "";
-	
-	TIFF* pInfile = TIFFOpen(infile.c_str(), "r");
-	if (!pInfile)
+
+	//find the blank pages first, the removal then only rewrites the IFD chain
+	if (m_Params._strRemoveMode != "decode")
 	{
-		m_strErrorMsg = "Error opening input file: " + infile;
-		return false;
+		std::set<uint16_t> pNumbers;
+		if (!FindBlankPages(infile, pNumbers))
+			return false;
+
+		return RemovePageByNumber(infile, pNumbers, outfile);
 	}
 	
-	iTotalPages = GetPageCount(pInfile);
+	m_strInputFile = infile;
+	m_strOutputFile = outfile;
 
-	for (uint16_t pageno = 0; pageno < iTotalPages; pageno++)
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOFiles(&pInfile, &pOutfile))
+		return false;
+
+	bRes = ProcessRemoveBlankPages(pInfile, pOutfile);
+
+	CloseIOFiles(&pInfile, &pOutfile, bRes);
+	return bRes;
+}
+
+bool CTiffProvider::RemovePageByNumber(std::string& infile, std::set<uint16_t>& pNumbers, std::string outfile)
+{
+	bool bRes = true;
+
+	m_strInputFile = infile;
+	m_strOutputFile = outfile;
+
+	//the remaining pages are copied(or relinked) as they are, libtiff is only used if that fails
+	if (m_Params._strRemoveMode != "decode")
 	{
-		if (TIFFSetDirectory(pInfile, pageno))
+		std::set<uint32_t> pages;
+		for (auto pno : pNumbers)
 		{
-			//get the tagheader info from the input file
-			GetTagInfo(pInfile);
+			if (pno > 0)
+				pages.emplace(pno - 1);
+		}
 
-			//Is the current page BLANK? If yes, dont process it.
-			if (IsPageType(pInfile, m_ePageType::BLANK))
-				iBlankpageCount++;
+		bool bTryDecode = true;
+		if (RemovePagesFromChain(pages, bTryDecode))
+			return true;
 
-			strTagInfo.append(("Page Number: " + std::to_string(pageno+1) += "\n"));
-			strTagInfo.append("---------------\n");
-			strTagInfo.append(("Width = " + std::to_string(m_TagHeader._width) + "\n"));
-			strTagInfo.append(("Height = " + std::to_string(m_TagHeader._height) + "\n"));
-			strTagInfo.append(("Layout(CONFIG) = " + std::to_string(m_TagHeader._config) + "\n"));
-			strTagInfo.append(("Phtometric = " + std::to_string(m_TagHeader._photometric) + "\n"));
-			strTagInfo.append(("Orientation = " + std::to_string(m_TagHeader._orientation) + "\n"));
-			strTagInfo.append(("Compression = " + std::to_string(m_TagHeader._compression) + "\n"));
-			strTagInfo.append(("Bits Per Sample = " + std::to_string(m_TagHeader._bitspersample) + "\n"));
-			strTagInfo.append(("Samples Per Pixel = " + std::to_string(m_TagHeader._samplesperpixel) + "\n\n"));
-		}
+		if (!bTryDecode)
+			return false;
 	}
 
-	fileinfo.append(("Total number of pages: " + std::to_string(iTotalPages) + "\n"));
-	fileinfo.append(("Total number of Blank pages: " + std::to_string(iBlankpageCount) + "\n\n"));
-	fileinfo.append(strTagInfo);
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOFiles(&pInfile, &pOutfile))
+		return false;
+
+	bRes = ProcessRemovePageByNumber(pInfile, pOutfile, pNumbers);
+
+	CloseIOFiles(&pInfile, &pOutfile, bRes);
+	return bRes;
+}
+
+//Miscellaneous operations
+bool CTiffProvider::GetFileInfo(std::string& infile, std::string& fileinfo, std::string outfile)
+{
+	TIFF* pInfile = OpenInputFile(infile);
+
+	if (!pInfile)
+	{
+		m_strErrorMsg = "Error opening input file: " + infile;
+		return false;
+	}
+	
+	ProcessFileInfo(pInfile, fileinfo);
 
 	TIFFClose(pInfile);
 
@@ -474,10 +1938,92 @@ bool CTiffProvider::GetFileInfo(std::string& infile, std::string& fileinfo, std:
 	return true;
 }
 
+bool CTiffProvider::Benchmark(std::string& infile, std::string& report)
+{
+	TIFF* pInfile = OpenInputFile(infile);
+	if (!pInfile)
+	{
+		m_strErrorMsg = "Error opening input file: " + infile;
+		return false;
+	}
+
+	double dScanlineTotal = 0, dStripTotal = 0, dScalarTotal = 0, dKernelTotal = 0;
+	uint16_t iPageCount = GetPageCount(pInfile);
+
+	//every page is decoded twice, once per scanline and once per strip(or tile).
+	//the gray kernel is timed on the decoded chunks of 8 bit RGB(A) pages, scalar against the SIMD level of the cpu
+	for (uint16_t pageno = 0; pageno < iPageCount; pageno++)
+	{
+		if (!m_PageIndex.SetPage(pageno))
+			continue;
+
+		CTiffStripReader reader;
+		if (!reader.Open(pInfile))
+		{
+			report.append("Page " + std::to_string(pageno + 1) + ": " + reader.GetErrorMsg() + "\n");
+			continue;
+		}
+
+		double dScanline = -1;
+		if (!reader.IsTiled())
+		{
+			std::vector<unsigned char> vLine(TIFFScanlineSize(pInfile));
+			uint32_t iHeight = 0;
+			TIFFGetField(pInfile, TIFFTAG_IMAGELENGTH, &iHeight);
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t row = 0; row < iHeight; row++)
+			{
+				if (TIFFReadScanline(pInfile, vLine.data(), row) < 0)
+					break;
+			}
+			dScanline = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			dScanlineTotal += dScanline;
+		}
+
+		GetTagInfo(pInfile);
+		bool bKernel = (m_TagHeader._bitspersample == 8) && ((m_TagHeader._samplesperpixel == 3) || (m_TagHeader._samplesperpixel == 4));
+		std::vector<unsigned char> vCopy;
+		double dStrip = 0;
+
+		for (uint32_t chunk = 0; chunk < reader.GetChunkCount(); chunk++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			if (!reader.ReadChunk(chunk))
+				break;
+			dStrip += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			if (bKernel)
+			{
+				size_t iPixels = (size_t)reader.GetChunkSize() / m_TagHeader._samplesperpixel;
+				vCopy.assign(reader.GetChunk(), reader.GetChunk() + reader.GetChunkSize());
+
+				start = std::chrono::steady_clock::now();
+				CTiffPixelKernels::ToGrayScalar(vCopy.data(), iPixels, m_TagHeader._samplesperpixel);
+				auto middle = std::chrono::steady_clock::now();
+				CTiffPixelKernels::ToGray(reader.GetChunk(), iPixels, m_TagHeader._samplesperpixel);
+				auto end = std::chrono::steady_clock::now();
+
+				dScalarTotal += std::chrono::duration<double, std::milli>(middle - start).count();
+				dKernelTotal += std::chrono::duration<double, std::milli>(end - middle).count();
+			}
+		}
+		dStripTotal += dStrip;
+
+		report.append("Page " + std::to_string(pageno + 1) + ": scanline " + (dScanline < 0 ? std::string("n/a(tiled)") : std::to_string(dScanline) + " ms")
+			+ ", strip " + std::to_string(dStrip) + " ms\n");
+	}
+
+	TIFFClose(pInfile);
+
+	report.append("Total: scanline " + std::to_string(dScanlineTotal) + " ms, strip " + std::to_string(dStripTotal) + " ms\n");
+	report.append("Gray kernel: scalar " + std::to_string(dScalarTotal) + " ms, " + CTiffPixelKernels::GetCpuLevelName() + " " + std::to_string(dKernelTotal) + " ms\n");
+	return true;
+}
+
 bool CTiffProvider::ConvertPageTo(std::string& infile, m_eConvertCode ccode, std::string outfile)
 {
 	bool bRes = true;
-	bool bTempFile = false;
 
 	m_strInputFile = infile;
 	m_strOutputFile = outfile;
@@ -486,39 +2032,157 @@ bool CTiffProvider::ConvertPageTo(std::string& infile, m_eConvertCode ccode, std
 	TIFF* pOutfile = nullptr;
 
 	//open input/output files for processing
-	if (!OpenIOFiles(&pInfile, &pOutfile))
+	if (!OpenIOFiles(&pInfile, &pOutfile, true, true))
 		return false;
 
-	uint16_t iPageCount = GetPageCount(pInfile);
+	bRes = ProcessConvertPageTo(pInfile, pOutfile, ccode);
 
-	for (uint16_t pno = 0; pno < iPageCount; pno++)
+	CloseIOFiles(&pInfile, &pOutfile, bRes);
+	return bRes;
+}
+
+//In-memory operations
+bool CTiffProvider::MergeFiles(const unsigned char* pData1, size_t iSize1, const unsigned char* pData2, size_t iSize2, std::vector<unsigned char>& outBuffer)
+{
+	bool bRes = true;
+
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	//a classic first image that would pass 4GB is written again as BigTIFF, followed by the second one
+	bool bBigTIFF = (iSize1 > 3) && ((pData1[2] == 43) || (pData1[3] == 43));
+	if (!bBigTIFF && (m_Params._strBigTIFF != "never"))
 	{
-		if (TIFFSetDirectory(pInfile, pno))
+		pInfile = CTiffMemoryStream::OpenRead(pData2, iSize2);
+		uint64_t iAppendedSize = pInfile ? EstimateOutputSize(pInfile, false) : 0;
+		if (pInfile)
+			TIFFClose(pInfile);
+
+		if (UseBigTIFF(iSize1 + iAppendedSize))
 		{
-			//get the tagheader info from the input file
-			GetTagInfo(pInfile);
+			if (!OpenIOBuffers(pData1, iSize1, outBuffer, &pInfile, &pOutfile, "w8"))
+				return false;
 
-			//if the input file is not a BLANK page, and has valid pixel format, then proceed for conversion
-			if (!IsPageType(pInfile, m_ePageType::BLANK) && ValidPixelFormat())
-			{
-				m_bToGrayScale = (ccode == m_eConvertCode::TOGRAY) ? true : false;
-				m_bToBinary = (ccode == m_eConvertCode::TOBINARY) ? true : false;
-			}
-			
-			if (!WriteData(pInfile, pOutfile))
+			bRes = ProcessMerge(pInfile, pOutfile);
+			TIFFClose(pInfile);
+
+			pInfile = CTiffMemoryStream::OpenRead(pData2, iSize2);
+			if (!pInfile)
 			{
-				m_strErrorMsg = "Error: Failed to write the data to destination.";
-				bRes = false;
-				break;
+				m_strErrorMsg = "Error opening input buffer!!";
+				TIFFClose(pOutfile);
+				outBuffer.clear();
+				return false;
 			}
 
-			m_bToGrayScale = false;
-			m_bToBinary = false;
-			TIFFFlush(pOutfile);
+			bRes = bRes && ProcessMerge(pInfile, pOutfile);
+
+			TIFFClose(pInfile);
+			TIFFClose(pOutfile);
+
+			//a half written image is not handed back
+			if (!bRes)
+				outBuffer.clear();
+
+			return bRes;
 		}
 	}
 
-	CloseIOFiles(&pInfile, &pOutfile);
+	//the output starts as a copy of the first image, the pages of the second one are appended to it
+	outBuffer.assign(pData1, pData1 + iSize1);
+
+	if (!OpenIOBuffers(pData2, iSize2, outBuffer, &pInfile, &pOutfile, "a"))
+		return false;
+
+	bRes = ProcessMerge(pInfile, pOutfile);
+
+	TIFFClose(pInfile);
+	TIFFClose(pOutfile);
+
+	if (!bRes)
+		outBuffer.clear();
+
+	return bRes;
+}
+
+bool CTiffProvider::RemoveBlankPages(const unsigned char* pData, size_t iSize, std::vector<unsigned char>& outBuffer)
+{
+	bool bRes = true;
+
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOBuffers(pData, iSize, outBuffer, &pInfile, &pOutfile))
+		return false;
+
+	bRes = ProcessRemoveBlankPages(pInfile, pOutfile);
+
+	TIFFClose(pInfile);
+	TIFFClose(pOutfile);
+
+	//a half written image is not handed back
+	if (!bRes)
+		outBuffer.clear();
+
+	return bRes;
+}
+
+bool CTiffProvider::RemovePageByNumber(const unsigned char* pData, size_t iSize, std::set<uint16_t>& pNumbers, std::vector<unsigned char>& outBuffer)
+{
+	bool bRes = true;
+
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOBuffers(pData, iSize, outBuffer, &pInfile, &pOutfile))
+		return false;
+
+	bRes = ProcessRemovePageByNumber(pInfile, pOutfile, pNumbers);
+
+	TIFFClose(pInfile);
+	TIFFClose(pOutfile);
+
+	//a half written image is not handed back
+	if (!bRes)
+		outBuffer.clear();
+
+	return bRes;
+}
+
+bool CTiffProvider::GetFileInfo(const unsigned char* pData, size_t iSize, std::string& fileinfo)
+{
+	TIFF* pInfile = CTiffMemoryStream::OpenRead(pData, iSize);
+	if (!pInfile)
+	{
+		m_strErrorMsg = "Error opening input buffer!!";
+		return false;
+	}
+
+	ProcessFileInfo(pInfile, fileinfo);
+
+	TIFFClose(pInfile);
+	return true;
+}
+
+bool CTiffProvider::ConvertPageTo(const unsigned char* pData, size_t iSize, m_eConvertCode ccode, std::vector<unsigned char>& outBuffer)
+{
+	bool bRes = true;
+
+	TIFF* pInfile = nullptr;
+	TIFF* pOutfile = nullptr;
+
+	if (!OpenIOBuffers(pData, iSize, outBuffer, &pInfile, &pOutfile, "w", true))
+		return false;
+
+	bRes = ProcessConvertPageTo(pInfile, pOutfile, ccode);
+
+	TIFFClose(pInfile);
+	TIFFClose(pOutfile);
+
+	//a half written image is not handed back
+	if (!bRes)
+		outBuffer.clear();
+
 	return bRes;
 }
 
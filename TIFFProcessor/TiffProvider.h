@@ -1,11 +1,26 @@
 #pragma once
 #include "tiffio.h"
+#include "TiffPageIndex.h"
+#include "TiffMappedFile.h"
+#include "TiffMemoryStream.h"
+#include "TiffIFDChain.h"
+#include "TiffStripReader.h"
+#include "TiffStripWriter.h"
+#include "TiffPixelKernels.h"
+#include "TiffJpegAnalyzer.h"
+#include "TiffJpegTranscoder.h"
+#include "TiffBinarizer.h"
+#include "TiffOrderedJobs.h"
 #include <string>
 #include <set>
 #include <map>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
 #include <Windows.h>
 #include <filesystem>
 //#include <experimental/filesystem>
@@ -25,20 +40,85 @@ typedef struct Header
 	uint16_t _compression;
 }TagHeader;
 
+//a decoded strip(or tile) on its way to the writer, sizes are in bytes of the converted pixels
+typedef struct ChunkInfo
+{
+	uint32_t _index;
+	uint32_t _x, _y;
+	uint32_t _width;
+	uint32_t _rows;			//rows inside the page
+	tmsize_t _rowBytes;		//bytes of a row inside the page
+	tmsize_t _size;			//bytes of the whole chunk, padding included
+}ChunkInfo;
+
+//the format of the strips(or tiles) of an output page, workers encode their chunks with it on their own
+typedef struct ChunkFormat
+{
+	TagHeader _header;
+	bool _bTiled;
+	uint32_t _iTileWidth;
+	uint32_t _iTileLength;
+	std::vector<uint16> _vExtraSamples;
+}ChunkFormat;
+
+//a chunk on its way from the read to the write of the chunk pipeline, the slots are used again for the chunks
+//after it, so their buffers keep the memory they have
+typedef struct ChunkSlot
+{
+	ChunkInfo _info;
+	std::vector<unsigned char> _vRaw;		//the chunk as it is stored in the input
+	std::vector<unsigned char> _vData;		//the chunk encoded for the output(or decoded, for the writer or the binarizer)
+	std::vector<unsigned char> _vTables;	//JPEGTABLES the chunk was encoded with, empty for other codecs
+}ChunkSlot;
+
+//a page done by a worker of the page engine, held until it is handed over in page order
+typedef struct PageOutput
+{
+	std::vector<unsigned char> _vData;	//the page as a single page TIFF in memory
+	bool _bWritten = false;				//false for pages that are left out(e.g. blank pages)
+	bool _bBlank = false;
+	std::string _strError = "";
+}PageOutput;
+
 //we can add more tiff parameters as we add features to this.
 typedef struct Params
 {
 	std::string _strFilesPath = "";
 	std::string _strCompressType = "JPEG";
 	uint16_t _iThreshold = 100;
+	bool _bRawCopy = true;		//copy unchanged pages strip by strip without decoding them
+	std::string _strRemoveMode = "rewrite";	//page removal: "decode", "rewrite"(IFD copy) or "inplace"(relink the IFD chain)
+	std::string _strMergeMode = "append";	//merging: "decode" or "append"(link the IFD chains)
+	std::string _strBigTIFF = "auto";		//BigTIFF output: "auto"(when the output may pass 4GB), "always" or "never"
+	std::string _strLayout = "input";		//layout of encoded pages: "input", "strips", "tiles" or "auto"
+	uint32_t _iStripSize = 65536;			//target strip size in bytes, used when _iRowsPerStrip is 0
+	uint32_t _iRowsPerStrip = 0;
+	uint32_t _iTileWidth = 256;
+	uint32_t _iTileLength = 256;
+	uint16_t _iBlankTolerance = 0;			//samples this close to white are not ink(0-255)
+	double _dBlankMaxInk = 0.0;				//a page with at most this percentage of ink is blank
+	uint16_t _iBlankMargin = 0;				//percentage of the width/height at each edge left out of the blank check
+	std::string _strBlankPrefilter = "ink";	//judge pages by their compressed size: "off", "ink"(only pages too large to be blank, with no tolerance and max ink) or "all"
+	bool _bDctAnalysis = true;				//classify JPEG pages from their DCT coefficients where these settle it
+	bool _bGrayTranscode = true;			//convert YCbCr JPEG pages to gray by keeping only their luma coefficients
+	bool _bKeepAlpha = true;				//gray pages of RGBA input keep the alpha as a second sample
+	std::string _strBinarize = "fixed";		//binarization threshold: "fixed"(_iThreshold), "otsu"(per page from its histogram),
+											//"sauvola" or "bradley"(per pixel from the window around it),
+											//"floyd" or "atkinson"(error diffusion dithering for photos and halftones)
+	uint16_t _iBinarizeWindow = 31;			//window size in pixels of sauvola and bradley
+	double _dSauvolaK = 0.2;				//sauvola k, higher values give less black
+	uint16_t _iBradleyPercent = 15;			//bradley: pixels this percentage below the window mean are black
+	uint16_t _iThreads = 0;					//worker threads(pages in parallel, or bands of a page), 0 uses one per core
+	uint16_t _iPipelineDepth = 4;			//chunks per worker thread between the read and the write of a page, bounds its memory
+	uint16_t _iBatchSplitPages = 32;		//-batch: conversions of files with more pages are split into tasks of this many pages, 0 never splits
 }TIFFParams;
 
 class CTiffProvider
 {
 private:
-	bool m_bUseTempOutfile;
-	bool m_bToGrayScale;
-	bool m_bToBinary;
+	bool m_bUseTempOutfile = false;
+	bool m_bToGrayScale = false;
+	bool m_bToBinary = false;
 
 	std::string m_strErrorMsg = "";
 	std::string m_strInputFile, m_strOutputFile;
@@ -46,21 +126,75 @@ private:
 	
 	TagHeader m_TagHeader;
 	TIFFParams m_Params;
+	CTiffPageIndex m_PageIndex;
 
 public:
 	typedef enum ConvertCode { TOBINARY = 0, TOGRAY = 1 } m_eConvertCode;
 	typedef enum PageType { BINARY = 1, GRAYSCALE, COLOUR, BLANK } m_ePageType;
+	typedef enum SizeClass { AMBIGUOUS = 0, BLANK_BY_SIZE, INK_BY_SIZE } m_eSizeClass;
+	typedef enum PageOperation { CONVERT_TOBINARY = 0, CONVERT_TOGRAY, REMOVE_BLANK } m_ePageOperation;
+	typedef enum ChunkOutput { ENCODED_CHUNK = 0, DECODED_CHUNK, GRAY_CHUNK } m_eChunkOutput;
+	typedef std::function<bool(const ChunkInfo& info, unsigned char* pData)> ChunkFunction;
 
 private:
 	void GetTagInfo(TIFF* pFile);
-	bool OpenIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bDeleteOutputFile = true);
-	void CloseIOFiles(TIFF** pInfile, TIFF** pOutfile);
+	TIFF* OpenInputFile(const std::string& strFile, CTiffMappedFile::m_eAccessHint eHint = CTiffMappedFile::SEQUENTIAL);
+	bool OpenIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bDeleteOutputFile = true, bool bConvert = false, uint64_t iAppendedSize = 0);
+	void CloseIOFiles(TIFF** pInfile, TIFF** pOutfile, bool bCommit = true);
+	std::string GetTempFile(const std::string& strFile);
+	bool OpenIOBuffers(const unsigned char* pData, size_t iSize, std::vector<unsigned char>& outBuffer, TIFF** pInfile, TIFF** pOutfile, const char* pMode = "w", bool bConvert = false);
 	uint16_t GetPageCount(TIFF* pfile);
 	int16_t WriteHeader(TIFF* pfile, TagHeader& header);
 	bool ValidPixelFormat();
 	bool IsPageType(TIFF* pFile, m_ePageType pType);
+	m_eSizeClass ClassifyBySize(TIFF* pFile);
+	bool MeasureInk(TIFF* pFile, bool bStopEarly, uint64_t& iInk, uint64_t& iSamples);
+	uint64_t CountInkInChunk(CTiffStripReader& reader, uint32_t iFirstRow, uint64_t iStopAfter);
+	void GetInkRegion(uint32_t& iLeft, uint32_t& iTop, uint32_t& iRight, uint32_t& iBottom);
+	uint64_t GetMaxInk(uint64_t iSamples);
+	uint64_t GetInkSamples();
+	CTiffJpegAnalyzer::m_eVerdict CheckJpegPage(TIFF* pFile, m_ePageType pType);
 	bool WriteData(TIFF* pInfile, TIFF* pOutfile);
-	bool ToGrayScale(unsigned char* pSourceImage, uint32_t lineSize, int iSamplesperpixel, bool ToBinary = false, int iThreshold = 0);
+	CTiffBinarizer::m_eMethod GetBinarizeMethod();
+	bool WriteChunk(CTiffStripWriter& writer, bool bSameLayout, const ChunkInfo& info, unsigned char* pData, tmsize_t iRowSize);
+	void ConvertChunk(CTiffStripReader& reader, ChunkInfo& info, tmsize_t iRowSize, int iOutPixelBits);
+	unsigned char* PrepareChunk(CTiffStripReader& decoder, ChunkInfo& info, bool bGray, tmsize_t iRowSize, int iOutPixelBits, std::vector<unsigned char>& vGray);
+	void GetChunkFormat(TIFF* pOutfile, ChunkFormat& format);
+	bool EncodeChunk(const ChunkFormat& format, const ChunkInfo& info, unsigned char* pData, std::vector<unsigned char>& vScratch, ChunkSlot& slot);
+	bool WriteChunksParallel(TIFF* pOutfile, CTiffStripReader& reader, std::vector<TIFF*>& vInputs, tmsize_t iRowSize, int iOutPixelBits, m_eChunkOutput eOutput, ChunkFunction fnChunk);
+	bool CopyPageTags(TIFF* pInfile, TIFF* pOutfile);
+	bool CopyRawData(TIFF* pInfile, TIFF* pOutfile);
+	bool TranscodeToGray(TIFF* pInfile, TIFF* pOutfile);
+	void GetOutputLayout(TIFF* pOutfile, CTiffStripReader& reader, uint32_t& iRowsPerStrip, uint32_t& iTileWidth, uint32_t& iTileLength);
+	bool ToGrayScale(const unsigned char* pSourceImage, unsigned char* pGrayImage, uint32_t lineSize, int iSamplesperpixel, int iGraySamples, bool ToBinary = false, int iThreshold = 0);
+	int GetGraySamples();
+
+	//output size estimation, classic TIFF offsets are limited to 4GB
+	uint64_t EstimateOutputSize(TIFF* pInfile, bool bConvert);
+	uint64_t EstimateOutputSize(const std::vector<std::string>& vFiles);
+	bool UseBigTIFF(uint64_t iEstimatedSize);
+	bool MergeToBigTIFF(std::string& infile1, std::vector<std::string>& vInfiles, uint64_t iAppendedSize);
+
+	//page removal on the IFD chain, pages are zero based
+	bool FindBlankPages(std::string& infile, std::set<uint16_t>& pages);
+	bool RemovePagesFromChain(std::set<uint32_t>& pages, bool& bTryDecode);
+
+	//page engine, the pages of the input are processed on worker threads that have their own provider and input handle
+	typedef std::function<bool(CTiffProvider& worker, TIFF* pInfile, uint16_t pno, PageOutput& page)> PageFunction;
+	typedef std::function<bool(uint16_t pno, PageOutput& page)> CommitFunction;
+	TIFF* OpenWorkerInput(TIFF* pInfile, CTiffMappedFile::m_eAccessHint eHint = CTiffMappedFile::SEQUENTIAL);
+	bool OpenChunkInputs(TIFF* pInfile, unsigned iCount, std::vector<TIFF*>& vInputs);
+	unsigned GetThreads(uint32_t iJobs);
+	bool RunPages(TIFF* pInfile, uint16_t iPageCount, unsigned iThreads, const PageFunction& fnPage, const CommitFunction& fnCommit);
+	bool ProcessPage(TIFF* pInfile, TIFF* pOutfile, uint16_t pno, m_ePageOperation op, bool& bWritten);
+	bool ProcessPages(TIFF* pInfile, TIFF* pOutfile, m_ePageOperation op);
+
+	//operations on open TIFF handles, shared by the file and the in-memory API
+	bool ProcessMerge(TIFF* pInfile, TIFF* pOutfile);
+	bool ProcessRemoveBlankPages(TIFF* pInfile, TIFF* pOutfile);
+	bool ProcessRemovePageByNumber(TIFF* pInfile, TIFF* pOutfile, std::set<uint16_t>& pages);
+	void ProcessFileInfo(TIFF* pInfile, std::string& fileinfo);
+	bool ProcessConvertPageTo(TIFF* pInfile, TIFF* pOutfile, m_eConvertCode ccode);
 
 public:
 	CTiffProvider() = default;
@@ -77,11 +211,21 @@ public:
 
 	//Required operations
 	bool MergeFiles(std::string& infile1, std::string& infile2);
+	bool MergeFiles(std::string& infile1, std::vector<std::string>& infiles);
 	bool RemoveBlankPages(std::string& infile, std::string outfile = "");
 	bool RemovePageByNumber(std::string& infile, std::set<uint16_t>& pages, std::string outfile = "");
 
 	//Miscellaneous operations
 	bool GetFileInfo(std::string& infile, std::string& fileinfo, std::string outfile = "");
+	bool Benchmark(std::string& infile, std::string& report);
 	bool ConvertPageTo(std::string& infile, m_eConvertCode ccode, std::string outfile = "" );
+
+	//In-memory operations, the input is a complete TIFF image in memory and the result is returned in outBuffer.
+	//outBuffer is left empty when an operation fails
+	bool MergeFiles(const unsigned char* pData1, size_t iSize1, const unsigned char* pData2, size_t iSize2, std::vector<unsigned char>& outBuffer);
+	bool RemoveBlankPages(const unsigned char* pData, size_t iSize, std::vector<unsigned char>& outBuffer);
+	bool RemovePageByNumber(const unsigned char* pData, size_t iSize, std::set<uint16_t>& pages, std::vector<unsigned char>& outBuffer);
+	bool GetFileInfo(const unsigned char* pData, size_t iSize, std::string& fileinfo);
+	bool ConvertPageTo(const unsigned char* pData, size_t iSize, m_eConvertCode ccode, std::vector<unsigned char>& outBuffer);
 };
 
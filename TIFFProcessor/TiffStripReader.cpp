@@ -0,0 +1,231 @@
+#include "TiffStripReader.h"
+#include <algorithm>
+
+bool CTiffStripReader::Open(TIFF* pFile)
+{
+	uint16 iCompression = COMPRESSION_NONE, iPhotometric = 0, iPlanar = PLANARCONFIG_CONTIG;
+	uint16 iBitsPerSample = 1, iSamplesPerPixel = 1;
+
+	m_pFile = pFile;
+	m_iChunk = 0;
+	m_iChunkX = 0;
+	m_iChunkY = 0;
+	m_iRowsInChunk = 0;
+	m_iRowBytesInChunk = 0;
+
+	TIFFGetField(pFile, TIFFTAG_IMAGEWIDTH, &m_iWidth);
+	TIFFGetField(pFile, TIFFTAG_IMAGELENGTH, &m_iHeight);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_COMPRESSION, &iCompression);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_PLANARCONFIG, &iPlanar);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_BITSPERSAMPLE, &iBitsPerSample);
+	TIFFGetFieldDefaulted(pFile, TIFFTAG_SAMPLESPERPIXEL, &iSamplesPerPixel);
+	TIFFGetField(pFile, TIFFTAG_PHOTOMETRIC, &iPhotometric);
+
+	//the chunks hold interleaved pixels, separate planes would need one chunk per sample
+	if (iPlanar != PLANARCONFIG_CONTIG)
+	{
+		m_strErrorMsg = "Separate planar pages are not supported!!";
+		return false;
+	}
+
+	//let the JPEG codec convert the subsampled YCbCr data, the kernels work on RGB
+	if ((iCompression == COMPRESSION_JPEG) && (iPhotometric == PHOTOMETRIC_YCBCR))
+		TIFFSetField(pFile, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+
+	m_bTiled = (TIFFIsTiled(pFile) != 0);
+	m_iPixelBits = (uint32_t)iBitsPerSample * iSamplesPerPixel;
+	m_iPageRowSize = TIFFScanlineSize(pFile);
+
+	if (m_bTiled)
+	{
+		TIFFGetField(pFile, TIFFTAG_TILEWIDTH, &m_iChunkWidth);
+		TIFFGetField(pFile, TIFFTAG_TILELENGTH, &m_iChunkLength);
+		m_iRowSize = TIFFTileRowSize(pFile);
+		m_vChunk.resize(TIFFTileSize(pFile));
+	}
+	else
+	{
+		m_iChunkWidth = m_iWidth;
+		m_iChunkLength = m_iHeight;
+		TIFFGetFieldDefaulted(pFile, TIFFTAG_ROWSPERSTRIP, &m_iChunkLength);
+		m_iChunkLength = std::min(std::max(m_iChunkLength, (uint32_t)1), std::max(m_iHeight, (uint32_t)1));
+		m_iRowSize = m_iPageRowSize;
+		m_vChunk.resize((size_t)m_iRowSize * m_iChunkLength);
+	}
+
+	if ((m_iRowSize <= 0) || (m_iPageRowSize <= 0) || (m_iChunkWidth == 0) || (m_iChunkLength == 0) || m_vChunk.empty())
+	{
+		m_strErrorMsg = "Invalid page layout!!";
+		return false;
+	}
+
+	return true;
+}
+
+bool CTiffStripReader::IsTiled() const
+{
+	return m_bTiled;
+}
+
+uint32_t CTiffStripReader::GetChunkCount() const
+{
+	if ((m_iChunkWidth == 0) || (m_iChunkLength == 0))
+		return 0;
+
+	uint32_t iAcross = (m_iWidth + m_iChunkWidth - 1) / m_iChunkWidth;
+	uint32_t iDown = (m_iHeight + m_iChunkLength - 1) / m_iChunkLength;
+
+	return iAcross * iDown;
+}
+
+uint32_t CTiffStripReader::GetChunkWidth() const
+{
+	return m_iChunkWidth;
+}
+
+uint32_t CTiffStripReader::GetChunkLength() const
+{
+	return m_iChunkLength;
+}
+
+tmsize_t CTiffStripReader::GetRowSize() const
+{
+	return m_iRowSize;
+}
+
+bool CTiffStripReader::SetChunk(uint32_t iChunk)
+{
+	if (iChunk >= GetChunkCount())
+	{
+		m_strErrorMsg = "Invalid chunk number!!";
+		return false;
+	}
+
+	//chunks are numbered row by row, strips are chunks as wide as the page
+	uint32_t iAcross = (m_iWidth + m_iChunkWidth - 1) / m_iChunkWidth;
+	m_iChunk = iChunk;
+	m_iChunkX = (iChunk % iAcross) * m_iChunkWidth;
+	m_iChunkY = (iChunk / iAcross) * m_iChunkLength;
+	m_iRowsInChunk = std::min(m_iChunkLength, m_iHeight - m_iChunkY);
+
+	//tile widths are multiples of 16, so a tile always starts on a byte boundary
+	tmsize_t iOffset = (tmsize_t)(((uint64_t)m_iChunkX * m_iPixelBits) / 8);
+	m_iRowBytesInChunk = std::min(m_iRowSize, m_iPageRowSize - iOffset);
+
+	return true;
+}
+
+bool CTiffStripReader::ReadChunk(uint32_t iChunk, uint32_t iRows)
+{
+	if (!SetChunk(iChunk))
+		return false;
+
+	if (m_bTiled)
+	{
+		if (TIFFReadEncodedTile(m_pFile, iChunk, m_vChunk.data(), (tmsize_t)m_vChunk.size()) < 0)
+		{
+			m_strErrorMsg = "Error decoding tile " + std::to_string(iChunk) + "!!";
+			return false;
+		}
+
+		return true;
+	}
+
+	//the last strip may be shorter, the codec is asked for exactly the rows it has(or the ones asked for)
+	if (iRows > 0)
+		m_iRowsInChunk = std::min(m_iRowsInChunk, iRows);
+
+	tmsize_t iSize = (tmsize_t)m_iRowsInChunk * m_iRowSize;
+	if (TIFFReadEncodedStrip(m_pFile, iChunk, m_vChunk.data(), iSize) < iSize)
+	{
+		m_strErrorMsg = "Error decoding strip " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	return true;
+}
+
+bool CTiffStripReader::ReadRawChunk(uint32_t iChunk, std::vector<unsigned char>& vRaw)
+{
+	if (iChunk >= GetChunkCount())
+	{
+		m_strErrorMsg = "Invalid chunk number!!";
+		return false;
+	}
+
+	//the buffer keeps its memory, so the same buffers serve all the chunks of a page
+	tmsize_t iSize = (tmsize_t)TIFFGetStrileByteCount(m_pFile, iChunk);
+	vRaw.resize((size_t)iSize);
+
+	tmsize_t iRead = -1;
+	if (iSize > 0)
+		iRead = m_bTiled ? TIFFReadRawTile(m_pFile, iChunk, vRaw.data(), iSize) : TIFFReadRawStrip(m_pFile, iChunk, vRaw.data(), iSize);
+
+	if (iRead != iSize)
+	{
+		m_strErrorMsg = "Error reading chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	return true;
+}
+
+bool CTiffStripReader::DecodeChunk(uint32_t iChunk, std::vector<unsigned char>& vRaw)
+{
+	if (!SetChunk(iChunk))
+		return false;
+
+	//the last strip may be shorter, the codec is asked for exactly the rows it has
+	tmsize_t iSize = m_bTiled ? (tmsize_t)m_vChunk.size() : (tmsize_t)m_iRowsInChunk * m_iRowSize;
+	if (vRaw.empty() || !TIFFReadFromUserBuffer(m_pFile, iChunk, vRaw.data(), (tmsize_t)vRaw.size(), m_vChunk.data(), iSize))
+	{
+		m_strErrorMsg = "Error decoding chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	return true;
+}
+
+unsigned char* CTiffStripReader::GetChunk()
+{
+	return m_vChunk.data();
+}
+
+tmsize_t CTiffStripReader::GetChunkSize() const
+{
+	//tiles are always written whole, strips only with the rows they have
+	return m_bTiled ? (tmsize_t)m_vChunk.size() : (tmsize_t)m_iRowsInChunk * m_iRowSize;
+}
+
+uint32_t CTiffStripReader::GetChunkX() const
+{
+	return m_iChunkX;
+}
+
+uint32_t CTiffStripReader::GetChunkY() const
+{
+	return m_iChunkY;
+}
+
+uint32_t CTiffStripReader::GetRowsInChunk() const
+{
+	return m_iRowsInChunk;
+}
+
+tmsize_t CTiffStripReader::GetRowBytesInChunk() const
+{
+	return m_iRowBytesInChunk;
+}
+
+unsigned char* CTiffStripReader::GetChunkRow(uint32_t iRow)
+{
+	if (iRow >= m_iRowsInChunk)
+		return nullptr;
+
+	return m_vChunk.data() + (size_t)iRow * m_iRowSize;
+}
+
+std::string CTiffStripReader::GetErrorMsg()
+{
+	return m_strErrorMsg;
+}
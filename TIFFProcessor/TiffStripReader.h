@@ -0,0 +1,70 @@
+#pragma once
+#include "tiffio.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//decodes the current page of a TIFF file a chunk at a time into a reusable buffer.
+//a chunk is one strip, or one tile for tiled pages, and it is decoded with a single
+//TIFFReadEncodedStrip/TIFFReadEncodedTile call instead of one codec call per scanline.
+//tiles are never assembled into full width rows, the pixel kernels run on the rows of each tile.
+class CTiffStripReader
+{
+private:
+	TIFF* m_pFile = nullptr;
+	bool m_bTiled = false;
+	uint32_t m_iWidth = 0;
+	uint32_t m_iHeight = 0;
+	uint32_t m_iChunkWidth = 0;		//page width, or tile width for tiled pages
+	uint32_t m_iChunkLength = 0;	//rows per strip, or tile length for tiled pages
+	uint32_t m_iPixelBits = 0;
+	tmsize_t m_iRowSize = 0;		//bytes per row of a chunk
+	tmsize_t m_iPageRowSize = 0;	//bytes per row of the page
+
+	uint32_t m_iChunk = 0;
+	uint32_t m_iChunkX = 0, m_iChunkY = 0;
+	uint32_t m_iRowsInChunk = 0;
+	tmsize_t m_iRowBytesInChunk = 0;
+	std::vector<unsigned char> m_vChunk;
+	std::string m_strErrorMsg = "";
+
+	bool SetChunk(uint32_t iChunk);
+
+public:
+	CTiffStripReader() = default;
+	~CTiffStripReader() = default;
+
+	//avoid copying of this objects
+	CTiffStripReader(const CTiffStripReader& second) = delete;
+
+	//prepares the current page of the file, JPEG YCbCr pages are decoded as RGB
+	bool Open(TIFF* pFile);
+
+	bool IsTiled() const;
+	uint32_t GetChunkCount() const;
+	uint32_t GetChunkWidth() const;
+	uint32_t GetChunkLength() const;
+	tmsize_t GetRowSize() const;
+
+	//decodes the given chunk, its rows stay valid until the next ReadChunk.
+	//iRows decodes only the top rows of a strip, tiles are always decoded whole
+	bool ReadChunk(uint32_t iChunk, uint32_t iRows = 0);
+	unsigned char* GetChunk();
+	tmsize_t GetChunkSize() const;
+
+	//reads the chunk as it is stored in the file, for decoding it with DecodeChunk(on another handle of the page)
+	bool ReadRawChunk(uint32_t iChunk, std::vector<unsigned char>& vRaw);
+
+	//decodes a chunk read with ReadRawChunk like ReadChunk, without any I/O. the codec may modify vRaw
+	bool DecodeChunk(uint32_t iChunk, std::vector<unsigned char>& vRaw);
+
+	//position of the chunk in the page and the part of it inside the page,
+	//edge tiles are padded and only the first rows/bytes of them hold pixels
+	uint32_t GetChunkX() const;
+	uint32_t GetChunkY() const;
+	uint32_t GetRowsInChunk() const;
+	tmsize_t GetRowBytesInChunk() const;
+	unsigned char* GetChunkRow(uint32_t iRow);
+
+	std::string GetErrorMsg();
+};
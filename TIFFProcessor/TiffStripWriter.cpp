@@ -0,0 +1,176 @@
+#include "TiffStripWriter.h"
+#include <algorithm>
+#include <cstring>
+
+bool CTiffStripWriter::Open(TIFF* pFile, uint32_t iRowsPerStrip)
+{
+	m_pFile = pFile;
+	m_bTiled = false;
+	m_iChunkLength = iRowsPerStrip;
+
+	SetColorMode();
+
+	if ((iRowsPerStrip == 0) || !TIFFSetField(pFile, TIFFTAG_ROWSPERSTRIP, iRowsPerStrip))
+	{
+		m_strErrorMsg = "Invalid rows per strip!!";
+		return false;
+	}
+
+	m_iRowSize = TIFFScanlineSize(pFile);
+	return Prepare();
+}
+
+bool CTiffStripWriter::OpenTiled(TIFF* pFile, uint32_t iTileWidth, uint32_t iTileLength)
+{
+	m_pFile = pFile;
+	m_bTiled = true;
+	m_iChunkLength = iTileLength;
+
+	SetColorMode();
+
+	if (!TIFFSetField(pFile, TIFFTAG_TILEWIDTH, iTileWidth) || !TIFFSetField(pFile, TIFFTAG_TILELENGTH, iTileLength))
+	{
+		m_strErrorMsg = "Invalid tile size!!";
+		return false;
+	}
+
+	m_iRowSize = TIFFTileRowSize(pFile);
+	return Prepare();
+}
+
+bool CTiffStripWriter::Prepare()
+{
+	uint16 iBitsPerSample = 1, iSamplesPerPixel = 1;
+
+	TIFFGetField(m_pFile, TIFFTAG_IMAGEWIDTH, &m_iWidth);
+	TIFFGetField(m_pFile, TIFFTAG_IMAGELENGTH, &m_iHeight);
+	TIFFGetFieldDefaulted(m_pFile, TIFFTAG_BITSPERSAMPLE, &iBitsPerSample);
+	TIFFGetFieldDefaulted(m_pFile, TIFFTAG_SAMPLESPERPIXEL, &iSamplesPerPixel);
+
+	m_iPixelBits = (uint32_t)iBitsPerSample * iSamplesPerPixel;
+	m_iChunkWidth = m_bTiled ? 0 : m_iWidth;
+	if (m_bTiled)
+		TIFFGetField(m_pFile, TIFFTAG_TILEWIDTH, &m_iChunkWidth);
+
+	m_iPageRowSize = TIFFScanlineSize(m_pFile);
+	m_iBandY = 0;
+	m_vBand.clear();
+	m_vTile.clear();
+
+	if ((m_iRowSize <= 0) || (m_iPageRowSize <= 0) || (m_iChunkWidth == 0) || (m_iChunkLength == 0))
+	{
+		m_strErrorMsg = "Invalid page layout!!";
+		return false;
+	}
+
+	return true;
+}
+
+void CTiffStripWriter::SetColorMode()
+{
+	uint16 iCompression = COMPRESSION_NONE, iPhotometric = 0;
+
+	TIFFGetFieldDefaulted(m_pFile, TIFFTAG_COMPRESSION, &iCompression);
+	TIFFGetField(m_pFile, TIFFTAG_PHOTOMETRIC, &iPhotometric);
+
+	//the chunks are RGB, the JPEG codec does the YCbCr conversion and subsampling
+	if ((iCompression == COMPRESSION_JPEG) && (iPhotometric == PHOTOMETRIC_YCBCR))
+		TIFFSetField(m_pFile, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+}
+
+tmsize_t CTiffStripWriter::GetRowSize() const
+{
+	return m_iRowSize;
+}
+
+bool CTiffStripWriter::WriteChunk(uint32_t iChunk, unsigned char* pData, tmsize_t iSize)
+{
+	tmsize_t iWritten = m_bTiled ? TIFFWriteEncodedTile(m_pFile, iChunk, pData, iSize)
+								 : TIFFWriteEncodedStrip(m_pFile, iChunk, pData, iSize);
+	if (iWritten < 0)
+	{
+		m_strErrorMsg = "Error encoding chunk " + std::to_string(iChunk) + "!!";
+		return false;
+	}
+
+	return true;
+}
+
+bool CTiffStripWriter::AddRegion(uint32_t x, uint32_t y, uint32_t iRows, tmsize_t iRowBytes, const unsigned char* pData, tmsize_t iStride)
+{
+	if ((y < m_iBandY) || (y + iRows > m_iHeight))
+	{
+		m_strErrorMsg = "Region outside of the band!!";
+		return false;
+	}
+
+	//the band grows to hold the rows of the region, rows already written are dropped in FlushRows
+	size_t iBandSize = (size_t)(y + iRows - m_iBandY) * m_iPageRowSize;
+	if (m_vBand.size() < iBandSize)
+		m_vBand.resize(iBandSize);
+
+	tmsize_t iOffset = (tmsize_t)(((uint64_t)x * m_iPixelBits) / 8);
+	tmsize_t iCopySize = std::min(iRowBytes, m_iPageRowSize - iOffset);
+
+	for (uint32_t row = 0; row < iRows; row++)
+		memcpy(m_vBand.data() + (size_t)(y - m_iBandY + row) * m_iPageRowSize + iOffset, pData + (size_t)row * iStride, iCopySize);
+
+	return true;
+}
+
+bool CTiffStripWriter::FlushRows(uint32_t iCompleteRows)
+{
+	iCompleteRows = std::min(iCompleteRows, m_iHeight);
+
+	//whole chunk rows are written as soon as they are complete, the last one once the page is
+	while ((iCompleteRows - m_iBandY >= m_iChunkLength) || ((iCompleteRows == m_iHeight) && (iCompleteRows > m_iBandY)))
+	{
+		uint32_t iRows = std::min(m_iChunkLength, m_iHeight - m_iBandY);
+
+		if (!WriteBand(iRows))
+			return false;
+
+		//keep the rows that belong to the next chunk row
+		size_t iWritten = (size_t)iRows * m_iPageRowSize;
+		if (m_vBand.size() > iWritten)
+			memmove(m_vBand.data(), m_vBand.data() + iWritten, m_vBand.size() - iWritten);
+		m_vBand.resize(m_vBand.size() - std::min(m_vBand.size(), iWritten));
+
+		m_iBandY += iRows;
+	}
+
+	return true;
+}
+
+bool CTiffStripWriter::WriteBand(uint32_t iRows)
+{
+	if (m_vBand.size() < (size_t)iRows * m_iPageRowSize)
+		m_vBand.resize((size_t)iRows * m_iPageRowSize);
+
+	//the rows of a strip are the rows of the band
+	if (!m_bTiled)
+		return WriteChunk(m_iBandY / m_iChunkLength, m_vBand.data(), (tmsize_t)iRows * m_iPageRowSize);
+
+	//tiles are cut out of the band, the part of edge tiles outside of the page is zero
+	m_vTile.resize(TIFFTileSize(m_pFile));
+
+	for (uint32_t x = 0; x < m_iWidth; x += m_iChunkWidth)
+	{
+		tmsize_t iOffset = (tmsize_t)(((uint64_t)x * m_iPixelBits) / 8);
+		tmsize_t iCopySize = std::min(m_iRowSize, m_iPageRowSize - iOffset);
+
+		memset(m_vTile.data(), 0, m_vTile.size());
+		for (uint32_t row = 0; row < iRows; row++)
+			memcpy(m_vTile.data() + (size_t)row * m_iRowSize, m_vBand.data() + (size_t)row * m_iPageRowSize + iOffset, iCopySize);
+
+		if (!WriteChunk(TIFFComputeTile(m_pFile, x, m_iBandY, 0, 0), m_vTile.data(), (tmsize_t)m_vTile.size()))
+			return false;
+	}
+
+	return true;
+}
+
+std::string CTiffStripWriter::GetErrorMsg()
+{
+	return m_strErrorMsg;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "tiffio.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//encodes a page a strip or a tile at a time with TIFFWriteEncodedStrip/TIFFWriteEncodedTile.
+//the chunks are handed over whole when the output has the layout of the input, otherwise the
+//decoded chunks are collected into a band of full rows and cut into the strips or tiles of the output.
+class CTiffStripWriter
+{
+private:
+	TIFF* m_pFile = nullptr;
+	bool m_bTiled = false;
+	uint32_t m_iWidth = 0;
+	uint32_t m_iHeight = 0;
+	uint32_t m_iChunkWidth = 0;		//page width, or tile width for tiled output
+	uint32_t m_iChunkLength = 0;	//rows per strip, or tile length for tiled output
+	uint32_t m_iPixelBits = 0;
+	tmsize_t m_iRowSize = 0;
+	tmsize_t m_iPageRowSize = 0;
+
+	uint32_t m_iBandY = 0;			//first row of the page held by the band
+	std::vector<unsigned char> m_vBand;
+	std::vector<unsigned char> m_vTile;
+	std::string m_strErrorMsg = "";
+
+	bool Prepare();
+	void SetColorMode();
+	bool WriteBand(uint32_t iRows);
+
+public:
+	CTiffStripWriter() = default;
+	~CTiffStripWriter() = default;
+
+	//avoid copying of this objects
+	CTiffStripWriter(const CTiffStripWriter& second) = delete;
+
+	//called once the tags of the page are set, JPEG YCbCr pages are encoded from RGB
+	bool Open(TIFF* pFile, uint32_t iRowsPerStrip);
+	bool OpenTiled(TIFF* pFile, uint32_t iTileWidth, uint32_t iTileLength);
+
+	//bytes per row of a strip or a tile
+	tmsize_t GetRowSize() const;
+
+	//writes a strip(or tile) of iSize bytes, the data may be modified by the codec
+	bool WriteChunk(uint32_t iChunk, unsigned char* pData, tmsize_t iSize);
+
+	//copies a decoded region of the page(iRows rows of iRowBytes bytes at pixel x,y) into the band
+	bool AddRegion(uint32_t x, uint32_t y, uint32_t iRows, tmsize_t iRowBytes, const unsigned char* pData, tmsize_t iStride);
+
+	//encodes the strips or tiles of the band that lie above iCompleteRows, all rows above it must have been added
+	bool FlushRows(uint32_t iCompleteRows);
+
+	std::string GetErrorMsg();
+};
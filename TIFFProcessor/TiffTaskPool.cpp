@@ -0,0 +1,125 @@
+#include "TiffTaskPool.h"
+#include <algorithm>
+#include <thread>
+
+//the pool and the queue of the thread that runs a task, tasks submitted by it go to its own queue
+static thread_local CTiffTaskPool* t_pPool = nullptr;
+static thread_local unsigned t_iWorker = 0;
+
+CTiffTaskPool::CTiffTaskPool(unsigned iThreads) : m_iThreads(std::max(1u, iThreads)), m_iQueued(0), m_iPending(0), m_iStolen(0)
+{
+	for (unsigned i = 0; i < m_iThreads; i++)
+		m_vQueues.emplace_back(new TaskQueue());
+}
+
+void CTiffTaskPool::Submit(const Task& task)
+{
+	unsigned iQueue = 0;
+	if (t_pPool == this)
+		iQueue = t_iWorker;
+	else
+	{
+		//tasks from outside are dealt out in turn
+		std::lock_guard<std::mutex> lock(m_mutex);
+		iQueue = m_iNextQueue;
+		m_iNextQueue = (m_iNextQueue + 1) % m_iThreads;
+	}
+
+	//counted under the sleep mutex before it is queued, so an idle thread cant miss the task
+	//and the count is never below the tasks in the queues
+	m_iPending++;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_iQueued++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_vQueues[iQueue]->_mutex);
+		m_vQueues[iQueue]->_tasks.push_back(task);
+	}
+
+	m_cvWork.notify_one();
+}
+
+bool CTiffTaskPool::TakeTask(unsigned iWorker, Task& task)
+{
+	{
+		TaskQueue& queue = *m_vQueues[iWorker];
+		std::lock_guard<std::mutex> lock(queue._mutex);
+		if (!queue._tasks.empty())
+		{
+			task = std::move(queue._tasks.front());
+			queue._tasks.pop_front();
+			m_iQueued--;
+			return true;
+		}
+	}
+
+	//the other queues are tried starting with the next thread, so the thieves spread over the queues
+	for (unsigned i = 1; i < m_iThreads; i++)
+	{
+		TaskQueue& queue = *m_vQueues[(iWorker + i) % m_iThreads];
+		std::lock_guard<std::mutex> lock(queue._mutex);
+		if (!queue._tasks.empty())
+		{
+			task = std::move(queue._tasks.back());
+			queue._tasks.pop_back();
+			m_iQueued--;
+			m_iStolen++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CTiffTaskPool::Work(unsigned iWorker)
+{
+	t_pPool = this;
+	t_iWorker = iWorker;
+
+	while (true)
+	{
+		Task task;
+		if (TakeTask(iWorker, task))
+		{
+			task();
+
+			//the last task wakes the idle threads, there is nothing left to wait for
+			if (--m_iPending == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_cvWork.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cvWork.wait(lock, [&]() { return (m_iQueued > 0) || (m_iPending == 0); });
+		if ((m_iPending == 0) && (m_iQueued == 0))
+			break;
+	}
+
+	t_pPool = nullptr;
+}
+
+void CTiffTaskPool::Run()
+{
+	std::vector<std::thread> vThreads;
+	for (unsigned i = 0; i < m_iThreads; i++)
+		vThreads.emplace_back(&CTiffTaskPool::Work, this, i);
+
+	for (std::thread& thread : vThreads)
+		thread.join();
+}
+
+unsigned CTiffTaskPool::GetThreads() const
+{
+	return m_iThreads;
+}
+
+uint64_t CTiffTaskPool::GetStolenTasks() const
+{
+	return m_iStolen;
+}
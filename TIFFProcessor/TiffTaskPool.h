@@ -0,0 +1,56 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+//runs tasks on a fixed number of threads with a task queue per thread.
+//a thread takes the tasks of its own queue from the front, in the order they were given,
+//and once its queue is empty it steals from the back of the queue of another thread.
+//tasks may submit more tasks, these go to the back of the queue of the thread running them,
+//so the parts of a large task are taken by the idle threads first
+class CTiffTaskPool
+{
+public:
+	typedef std::function<void()> Task;
+
+private:
+	typedef struct TaskQueue
+	{
+		std::mutex _mutex;
+		std::deque<Task> _tasks;
+	}TaskQueue;
+
+	unsigned m_iThreads = 1;
+	unsigned m_iNextQueue = 0;					//queue of the next task submitted from outside of the pool
+	std::vector<std::unique_ptr<TaskQueue>> m_vQueues;
+
+	std::mutex m_mutex;							//guards the sleep of idle threads
+	std::condition_variable m_cvWork;
+	std::atomic<uint64_t> m_iQueued;			//tasks in the queues
+	std::atomic<uint64_t> m_iPending;			//tasks submitted and not finished
+	std::atomic<uint64_t> m_iStolen;
+
+	bool TakeTask(unsigned iWorker, Task& task);
+	void Work(unsigned iWorker);
+
+public:
+	CTiffTaskPool(unsigned iThreads);
+	~CTiffTaskPool() = default;
+
+	//avoid copying of this objects
+	CTiffTaskPool(const CTiffTaskPool& second) = delete;
+
+	//queues a task, before Run or from a task that is running
+	void Submit(const Task& task);
+
+	//runs the tasks until all of them, and the tasks they submit, are done
+	void Run();
+
+	unsigned GetThreads() const;
+	uint64_t GetStolenTasks() const;
+};